@@ -0,0 +1,57 @@
+#!/bin/sh
+# Compares every way of running a circuit with "wireworld -b n" on the
+# graph engine, byte for byte: the other engines, -g, stripes (-j), a
+# one-copy sweep (-p), a delta stream read back with -x, a run saved
+# halfway as RLE or packed and resumed, and the library. Run by
+# "make check" as check.sh ./wireworld-check ./ww_check
+WW=$1
+LIB=$2
+GENS=500
+HALF=200
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+failed=0
+
+# same NAME COMMAND... - runs COMMAND and compares what it prints with
+# the reference
+same() {
+    name=$1
+    shift
+    if ! "$@" > "$OUT/got" 2> /dev/null || ! cmp -s "$OUT/ref" "$OUT/got"; then
+        echo "FAIL $circuit: $name"
+        failed=1
+    fi
+}
+
+for circuit in check/clock.txt check/wires.txt; do
+    "$WW" -b $GENS "$circuit" > "$OUT/ref" 2> /dev/null || exit 1
+
+    same "-e hashlife" "$WW" -b $GENS -e hashlife "$circuit"
+    same "-e sparse" "$WW" -b $GENS -e sparse "$circuit"
+    same "-e delay" "$WW" -b $GENS -e delay "$circuit"
+    if [ "$circuit" = check/clock.txt ]; then
+        same "-e dense" "$WW" -b $GENS -e dense "$circuit"
+    fi
+    same "-g" "$WW" -g $GENS "$circuit"
+    same "-g -e hashlife" "$WW" -g $GENS -e hashlife "$circuit"
+    same "-j 2" "$WW" -b $GENS -j 2 "$circuit"
+    same "-j 3 -w 4" "$WW" -b $GENS -j 3 -w 4 "$circuit"
+
+    echo > "$OUT/sweep.txt"
+    same "-p" "$WW" -b $GENS -p "$OUT/sweep.txt" "$circuit"
+
+    "$WW" -b $GENS -d "$OUT/stream.wwd" -K 64 "$circuit" > /dev/null 2>&1
+    same "-d then -x" "$WW" -x $GENS "$OUT/stream.wwd"
+
+    for save in save.rle save.wwb; do
+        "$WW" -b $HALF -o "$OUT/$save" "$circuit" > /dev/null 2>&1
+        same "-o $save then resume" "$WW" -b $((GENS - HALF)) "$OUT/$save"
+    done
+
+    same "ww_load and ww_step" "$LIB" "$circuit" $GENS
+done
+
+if [ $failed -ne 0 ]; then
+    exit 1
+fi
+echo "every mode matches -b on the graph engine"
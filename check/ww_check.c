@@ -0,0 +1,51 @@
+/* Wireworld library check */
+/* Runs a circuit through the functions in wireworld.h and prints the
+board the way "wireworld -b n" does, so check.sh can compare the two.
+The generations are run in two calls to check that a handle carries
+on where it left off */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../wireworld.h"
+
+int main(int argc, char **argv)
+{
+
+    Wireworld *ww;
+    unsigned long long n;
+    char *cells;
+    int error, row;
+
+    if (argc != 3) {
+        fprintf(stderr, "Error: Incorrect usage, try e.g. %s wirefile.txt 1000\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    n = strtoull(argv[2], NULL, 10);
+
+    if ((error = ww_load(argv[1], &ww)) != WW_OK ||
+        (error = ww_step(ww, n / 2)) != WW_OK ||
+        (error = ww_step(ww, n - n / 2)) != WW_OK) {
+        fprintf(stderr, "Error: %s\n", ww_error_message(error));
+        exit(EXIT_FAILURE);
+    }
+    if (ww_generation(ww) != n) {
+        fprintf(stderr, "Error: Handle is at generation %llu, not %llu\n", ww_generation(ww), n);
+        exit(EXIT_FAILURE);
+    }
+
+    if ((cells = (char *)malloc((size_t)ww_rows(ww) * ww_cols(ww))) == NULL) {
+        fprintf(stderr, "Error: Cannot allocate space. Not enough memory\n");
+        exit(EXIT_FAILURE);
+    }
+    ww_get_board(ww, cells);
+    for (row = 0; row < ww_rows(ww); row++) {
+        fwrite(cells + (size_t)row * ww_cols(ww), 1, ww_cols(ww), stdout);
+        putchar('\n');
+    }
+
+    free(cells);
+    ww_free(ww);
+
+    return 0;
+
+} /* end main */
@@ -6,12 +6,51 @@ electron tails by 't' and conductors by 'c'.
 
 In Linux terminals, this program will simulate wireworld 
 in an animation, using colours to represent the letters 'H', 
-'t', 'c' and ' '. */ 
+'t', 'c' and ' '. 
+
+Running it as "wireworld -g n wirefile.txt" prints generation n 
+instead. The circuit's cycle is found first, so n can be far larger 
+than could ever be simulated one generation at a time. Adding 
+"-e hashlife" uses a HashLife quadtree instead, which suits big 
+circuits built from many copies of the same parts. 
+
+Built with -DWW_LIBRARY there is no main or ncurses, and the 
+functions in wireworld.h let another program load and run circuits 
+through a handle, getting errors back rather than being exited. 
+Built with -DWW_NO_ANIMATION it is the whole program bar the 
+animation, so it doesn't need neillncurses. */ 
+
+/* The program is written for C99 (long long generations, designated 
+initialisers) with the __atomic builtins of gcc and clang, and builds 
+cleanly with -std=c99 -pedantic. This is the one place that is checked */
+#if !defined(__STDC_VERSION__) || __STDC_VERSION__ < 199901L || !defined(__GNUC__)
+#error "wireworld needs a C99 compiler with __atomic builtins, e.g. gcc -std=c99"
+#endif
+
+#define _POSIX_C_SOURCE 200809L
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
 #include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if !defined(WW_LIBRARY) && !defined(WW_NO_ANIMATION)
 #include "neillncurses.h"
+#endif
+#include "wireworld.h"
 
 #define MAX_COLS 40
 #define MAX_ROWS 40
@@ -25,317 +64,5421 @@ in an animation, using colours to represent the letters 'H',
 #define ELECTRON_TAIL 't'
 #define EMPTY ' '
 #define INCREMENT_NUM_HEADS (*pNum)++
-#define PRINT_NEWLINE puts("")
-#define VALID_CHARACTERS (c == 'H' || c == 't' || c == 'c' || c == ' ' || c == '\n' || c == EOF)
-#define END_ITERATION 500
+#define VALID_CHARACTERS (c == 'H' || c == 't' || c == 'c' || c == ' ' || c == '\n')
 #define CELL_ROW_LIMIT 2
 #define CELL_COL_LIMIT 2
 #define OUT_OF_BOUNDS 0
 #define IN_RANGE 1
+#define NOT_A_CONDUCTOR -1
+#define HEADS_TO_FIRE_MIN 1
+#define HEADS_TO_FIRE_MAX 2
+#define MAX_CYCLE_SEARCH 100000000ULL
+#define MAX_ORBIT_BYTES (64UL * 1024 * 1024)
+#define NO_JUMP 0
+#define JUMP 1
+#define ENGINE_GRAPH 0
+#define ENGINE_HASHLIFE 1
+#define ENGINE_DENSE 2
+#define ENGINE_SPARSE 3
+#define ENGINE_DELAY 4
+#define NO_BATCH 0
+#define BATCH 1
+#define FINAL_ONLY 0
+#define OUTPUT_BUFFER_SIZE (1 << 16)
+#define NANOSECONDS 1e9
+#define NO_EXTRACT 0
+#define EXTRACT 1
+#define DELTA_MAGIC "WWD2"
+#define DELTA_MAGIC_LENGTH 4
+#define DELTA_KEYFRAME 'K'
+#define DELTA_CHANGES 'D'
+#define DEFAULT_KEYFRAME_INTERVAL 256
+#define MAX_RUN_GAP 2
+#define VARINT_MORE 0x80
+#define VARINT_BITS 0x7F
+#define VARINT_SHIFT 7
+#define DEFAULT_FPS 10
+#define MILLISECONDS 1000
+#define NUM_FRAMES 3
+#define FRAME_INDEX 3
+#define FRAME_FRESH 4
+#define RUNNING 1
+#define STOPPED 0
+#define TAIL_PAIR 11
+#define CONDUCTOR_PAIR 12
+#define HEAD_PAIR 13
+#define EMPTY_PAIR 14
+/* each cell of the bit-sliced engine holds LANE_WORDS 64 bit words, 
+one bit per circuit. Build with -DLANE_WORDS=4 (and -mavx2) to run 
+256 circuits at once in 256 bit registers */
+#ifndef LANE_WORDS
+#define LANE_WORDS 1
+#endif
+#define LANE_BITS 64
+#define NUM_LANES (LANE_WORDS * LANE_BITS)
+#define MAX_LINE 4096
+#define CHUNK_BITS 6
+#define CHUNK_SIZE (1 << CHUNK_BITS)
+#define CHUNK_CELLS (CHUNK_SIZE * CHUNK_SIZE)
+#define HALO_SIZE (CHUNK_SIZE + 2)
+#define CHUNKS_PER_BLOCK 64
+#define INITIAL_CHUNK_SLOTS 64
+#define NUM_NEIGHBOURS 8
+#define FORMAT_TEXT 0
+#define FORMAT_RLE 1
+#define FORMAT_PACKED 2
+#define PACKED_MAGIC "WWB1"
+#define PACKED_MAGIC_LENGTH 4
+#define PACKED_HEADER_SIZE 20
+#define CELLS_PER_BYTE 4
+#define BITS_PER_CELL 2
+#define CELL_MASK 3
+#define MAX_BYTE 256
+#define RLE_EXTENSION ".rle"
+#define RLE_LINE_LENGTH 70
+#define RLE_STATES ".ABC"
+#define RLE_END_ROW '$'
+#define RLE_END '!'
+#define NO_CHECKPOINTS 0
+#define TEXT_BLOCK 16
+#define ALL_BYTES_VALID 0xFFFF
+#define READ_BLOCK (1 << 20)
+#define NO_STATS 0
+#define JSON_EXTENSION ".json"
+#define MICROSECONDS 1e6
+#define MAX_PROBE_NAME 64
+#define INITIAL_PROBES 16
+#define PROBE_BUFFER (1 << 16)
+#define VCD_ID_LENGTH 8
+#define VCD_FIRST_ID '!'
+#define VCD_ID_CHARS ('~' - '!' + 1)
+#define VCD_BITS 2
+#define ENGINE_ALL -1
+#define NO_BENCHMARK 0
+#define BENCHMARK 1
+#define CIRCUIT_CLOCK 0
+#define CIRCUIT_DIODE 1
+#define CIRCUIT_WIRE 2
+#define CIRCUIT_GATES 3
+#define CIRCUIT_RANDOM 4
+#define NUM_CIRCUITS 5
+#define NUM_ENGINES 5
+#define FIRST_BENCHMARK_SIZE 64
+#define MAX_BENCHMARK_SIZE 16384 /* keeps cell numbers of made up circuits in an int */
+#define RANDOM_CONDUCTORS 35 /* percent of cells in a random layout */
+#define RANDOM_HEADS 2
+#define PERCENT 100
+#define MAX_REFERENCE_WORK (1ULL << 28) /* cell updates the reference may take */
+#define KILOBYTE 1024.0
+#define RULE_WIREWORLD 0
+#define RULE_VON_NEUMANN 1
+#define RULE_SINGLE 2
+#define NUM_RULES 3
+#define MIN_WIRE_LENGTH 8 /* shorter wires are stepped a cell at a time */
+#define NOT_PLACED 0
+#define PLACED_JUNCTION 1
+#define PLACED_ON_WIRE 2
+#define SINGLE_PROCESS 1
+#define DEFAULT_HALO 1
+#define TOP_HALO 0
+#define BOTTOM_HALO 1
+#define MAX_SHM_NAME 64
+/* bit n of a rule's fires is set if a conductor with n neighbouring 
+heads becomes a head - wireworld fires on 1 or 2 */
+#define WIREWORLD_FIRES ((1 << 1) | (1 << 2))
+#define SINGLE_FIRES (1 << 1)
+#define FIRES(fires, n) ((((fires) >> (n)) & 1) ? ELECTRON_HEAD : CONDUCTOR)
+/* The whole of a rule as a table of next states, indexed by a cell 
+and the number of heads next to it. It is a constant, so each rule's 
+stepping function is compiled with its own table built in */
+#define RULE_TABLE(fires) { \
+    [ELECTRON_HEAD] = {ELECTRON_TAIL, ELECTRON_TAIL, ELECTRON_TAIL, ELECTRON_TAIL, \
+        ELECTRON_TAIL, ELECTRON_TAIL, ELECTRON_TAIL, ELECTRON_TAIL, ELECTRON_TAIL}, \
+    [ELECTRON_TAIL] = {CONDUCTOR, CONDUCTOR, CONDUCTOR, CONDUCTOR, \
+        CONDUCTOR, CONDUCTOR, CONDUCTOR, CONDUCTOR, CONDUCTOR}, \
+    [CONDUCTOR] = {FIRES(fires, 0), FIRES(fires, 1), FIRES(fires, 2), FIRES(fires, 3), \
+        FIRES(fires, 4), FIRES(fires, 5), FIRES(fires, 6), FIRES(fires, 7), FIRES(fires, 8)}}
+/* Defines the stepping function for one rule's table. Every cell's 
+heads are counted and its next state looked up, so there is no 
+branching on what the cell is */
+#define DEFINE_STEP_KERNEL(function, table) \
+static void function(Graph *g, state *cells, state *new_cells) \
+{ \
+    int i, k, num_heads; \
+    for (i = 0; i < g->num_cells; i++) { \
+        num_heads = 0; \
+        for (k = g->first_neighbour[i]; k < g->first_neighbour[i + 1]; k++) { \
+            num_heads += (cells[g->neighbours[k]] == ELECTRON_HEAD); \
+        } \
+        new_cells[i] = table[(unsigned char)cells[i]][num_heads]; \
+    } \
+}
+/* Counters for batch runs, only built with -DWW_STATS. Without it 
+the macros are empty, so the stepping loop is exactly as it was */
+#ifdef WW_STATS
+#define STATS_OPEN(s, opts, b, g, p) open_stats(&(s), opts, b, g, p)
+#define STATS_START(t) ((t) = seconds_now())
+#define STATS_LAP(s, phase, t) ((s).phase += stats_lap(&(t)))
+#define STATS_GENERATION(s, b, g, p, gen, last) stats_generation(&(s), b, g, p, gen, last)
+#define STATS_CLOSE(s) close_stats(&(s))
+#else
+#define STATS_OPEN(s, opts, b, g, p) ((void)0)
+#define STATS_START(t) ((void)0)
+#define STATS_LAP(s, phase, t) ((void)0)
+#define STATS_GENERATION(s, b, g, p, gen, last) ((void)0)
+#define STATS_CLOSE(s) ((void)0)
+#endif
+#define NO_NODE -1
+#define HL_CELL_EMPTY 0
+#define HL_CELL_HEAD 1
+#define HL_CELL_TAIL 2
+#define HL_CELL_CONDUCTOR 3
+#define HL_NUM_LEAVES 4
+#define HL_MIN_LEVEL 2
+#define HL_MAX_STEP 60
+#define HL_MAX_LEVEL (HL_MAX_STEP + 3)
+#define HL_INITIAL_NODES 1024
+#define HL_MAX_NODES (1 << 22)
+#define HL_NODE_CEILING (1 << 28) /* keeps node numbers and the pool's size in an int */
+#define HL_FREE -1
+#define NW 0
+#define NE 1
+#define SW 2
+#define SE 3
 
 typedef char state; 
+typedef unsigned long long generation;
+typedef unsigned long long lane;
+
+/* Only conductor cells ('c', 'H' and 't') ever change state, and 
+their neighbours never change once the file has been read. The 
+conductor graph holds just those cells, in row order, along with a 
+compressed sparse row (CSR) list of the conductors next to each one, 
+so a generation is a single pass over flat arrays */
+struct conductor_graph {
+    int num_cells; /* number of conductor cells */
+    int *position; /* row * cols + col of each conductor on the board */
+    /* neighbours of cell i are neighbours[first_neighbour[i]] up to 
+    neighbours[first_neighbour[i + 1] - 1] */
+    int *first_neighbour; 
+    int *neighbours; 
+    state *cells; /* state of each conductor this generation */
+    state *new_cells; /* state of each conductor next generation */
+    struct rule *rule; /* the rule the graph was compiled for */
+};
+
+typedef struct conductor_graph Graph;
+
+/* A wireworld-like rule - which cells are a cell's neighbours, as 
+offsets from it, and the function which steps a graph under it */
+struct rule {
+    char *name; 
+    int num_offsets; 
+    int row_offset[NUM_NEIGHBOURS], col_offset[NUM_NEIGHBOURS]; 
+    void (*step)(Graph *g, state *cells, state *new_cells); 
+};
+
+typedef struct rule Rule;
+
+/* A closed circuit eventually repeats itself. Generation n (for n at 
+least pre_period) is the same as generation 
+pre_period + (n - pre_period) % period, so any generation can be 
+found without simulating all of the generations before it */
+struct cycle {
+    generation pre_period; /* first generation which is part of the cycle */
+    generation period; /* number of generations before it repeats */
+    state *start; /* conductors in generation 0 */
+    /* conductors of every generation in the cycle, or just of generation 
+    pre_period if they would take more than MAX_ORBIT_BYTES */
+    state *orbit; 
+    int whole_orbit; /* 1 if orbit holds every generation in the cycle */
+};
+
+typedef struct cycle Cycle;
+
+/* A HashLife quadtree node covers 2^level by 2^level cells. Nodes 
+are canonical - there is only ever one node with the same four 
+children - so repeated parts of a circuit share nodes, and a node's 
+result (its centre half, 2^step generations later) only has to be 
+worked out once. Nodes are kept in one array and refer to each other 
+by index, so the array can grow */
+struct hashlife_node {
+    int quad[4]; /* NW, NE, SW and SE children - leaves have none */
+    int result; /* centre advanced 2^step generations, or NO_NODE */
+    int next; /* next node in the same hash bucket, or the free list */
+    signed char level; /* HL_FREE if the node is not in use */
+    signed char step; 
+    char marked; /* reachable from the root, used when collecting garbage */
+};
+
+typedef struct hashlife_node HashNode;
+
+/* The nodes one call of hl_successor is working with. They live in 
+the HashLife rather than on the C stack, so garbage can be collected 
+part way through a step without freeing them */
+struct hashlife_frame {
+    int grid[4][4]; /* grandchildren of the node being moved on */
+    int middle[3][3]; 
+    int quarter[2][2]; 
+};
+
+typedef struct hashlife_frame HashFrame;
+
+struct hashlife {
+    HashNode *nodes; /* nodes 0 to 3 are the leaves, one per cell state */
+    int capacity; /* size of nodes and buckets, a power of 2 */
+    int num_nodes; /* nodes in use */
+    int free_list; /* first unused node */
+    int *buckets; /* first node of each hash bucket */
+    int empty[HL_MAX_LEVEL + 1]; /* all-empty node of each level, or NO_NODE */
+    int root; 
+    long long origin_row, origin_col; /* where board cell (0, 0) is in the root */
+    int rows, cols; /* size of the board */
+    int max_nodes; /* collect garbage once more nodes than this are in use */
+    HashFrame frames[HL_MAX_LEVEL + 1]; /* one for each hl_successor being worked out */
+    int depth; /* frames in use */
+};
+
+typedef struct hashlife HashLife;
+
+/* A delta stream records every generation of a board. Frames whose 
+number is a multiple of keyframe_interval are keyframes, holding 
+every cell. Every other frame only holds the runs of cells which 
+changed since the frame before, as (gap, length, cells) where gap 
+is the number of unchanged cells since the end of the last run. 
+Frames are numbered by generation, so a resumed run's stream starts 
+at the generation it was saved at, always with a keyframe. Numbers 
+are written as varints, 7 bits a byte */
+struct delta_stream {
+    FILE *fp; 
+    int rows, cols; 
+    generation keyframe_interval; 
+    generation first; /* number of the first frame */
+    generation frame; /* number of the next frame to be written */
+    state *previous; /* the last frame written */
+};
+
+typedef struct delta_stream DeltaStream;
+
+/* Hands finished generations from the simulation thread to the 
+display without either waiting on a lock. The writer fills its back 
+frame and swaps it with the middle one, marking it FRAME_FRESH. The 
+reader swaps its front frame with the middle one only if it is 
+fresh, so it always gets the newest whole generation and generations 
+it was too slow to see are skipped */
+struct triple_buffer {
+    state *frames[NUM_FRAMES];
+    generation gens[NUM_FRAMES]; /* generation held in each frame */
+    int back; /* frame owned by the writer */
+    int middle; /* frame index, plus FRAME_FRESH if not yet read */
+    int front; /* frame owned by the reader */
+};
+
+typedef struct triple_buffer TripleBuffer;
+
+/* what the simulation thread needs */
+struct simulation {
+    Graph *g; 
+    TripleBuffer *tb; 
+    int running; /* set to STOPPED by the display to end the thread */
+};
+
+typedef struct simulation Simulation;
+
+/* Many copies of the same circuit, differing only in their signals, 
+stepped together. Bit k of a cell's lanes is that cell in copy k - 
+heads says which copies have an electron head there and tails which 
+have a tail, and a cell with neither is a plain conductor. The 
+conductor graph is shared, so one pass over it steps every copy */
+struct sliced_graph {
+    Graph *g; 
+    int num_instances; /* copies in use, at most NUM_LANES */
+    lane *heads, *tails; /* LANE_WORDS words for each conductor */
+    lane *new_heads, *new_tails; 
+};
+
+typedef struct sliced_graph SlicedGraph;
+
+/* A plain wire - a run of conductors which each touch only the one 
+before and the one after - between two junctions. A cell on it 
+becomes a head if either cell beside it is one (and it is neither a 
+head nor a tail), so signals just move along it a cell a generation. 
+Its cells are kept as bits, LANE_BITS to a word, and the whole wire 
+is stepped a word at a time */
+struct wire_segment {
+    int length; 
+    int *cells; /* conductor number of each cell, in order along the wire */
+    int ends[2]; /* conductor next to the first cell, and to the last */
+    int words; /* words in each of heads, tails and spare */
+    lane *heads, *tails; /* bit k is set if cell k is a head, or a tail */
+    lane *spare; /* the next generation's heads are worked out in here */
+    int active; /* 0 if there is no signal anywhere on the wire */
+};
+
+typedef struct wire_segment WireSegment;
+
+/* The conductor graph with every plain wire of at least 
+MIN_WIRE_LENGTH cells taken out as a WireSegment. Only the junctions, 
+gates and short wires left are stepped a cell at a time, so a 
+generation costs about the same however long the wires between them 
+are. The graph's cells are only kept up to date for those and for 
+the end cells of each wire, which are all that they read */
+struct delay_graph {
+    Graph *g; 
+    int num_junctions; 
+    int *junctions; /* conductor number of every cell not on a wire */
+    int num_wires; 
+    WireSegment *wires; 
+};
+
+typedef struct delay_graph DelayGraph;
+
+/* Start of the POSIX shared memory the stripe processes work 
+through. It is followed by the halo slots and a board the stripes 
+are gathered into for output */
+struct stripe_header {
+    int waiting; /* processes at the barrier */
+    int sense; /* flips each time every process has reached the barrier */
+    double sim_time; /* seconds the first stripe spent stepping */
+};
+
+typedef struct stripe_header StripeHeader;
+
+/* A board split into stripes of rows, each run by its own process. 
+Every halo generations each stripe puts its top and bottom halo rows 
+in a slot, and after a barrier takes its neighbours' rows out of 
+theirs. There are two slots a stripe, used in turn, so a stripe can 
+fill one while a slow neighbour is still reading the other */
+struct stripe_set {
+    StripeHeader *header; 
+    state *halos; /* halo rows, by slot, then stripe, then TOP_HALO or BOTTOM_HALO */
+    state *board; /* every stripe's rows, gathered for output */
+    int processes, halo, rows, cols; 
+};
+
+typedef struct stripe_set StripeSet;
 
-void invalid_argument(int argc, char argv[]);
-void read_file(FILE *fp, state arr[][MAX_COLS]);
-int check_characters(char c);
-void set_colors(NCURS_Simplewin *sw);
-void thousand_generations(state arr[][MAX_COLS], state new_arr[][MAX_COLS]);
-void printArray(state arr[][MAX_COLS]);
-void add_rules(state arr[][MAX_COLS], state new_arr[][MAX_COLS]);
-void copy_element(state arr[][MAX_COLS], state new_arr[][MAX_COLS], int row, int col);
-void apply_rules(state arr[][MAX_COLS], state new_arr[][MAX_COLS], int row, int col);
-int access_array_oob(state a[][MAX_COLS], int row, int col);
-int num_electron_heads(state a[][MAX_COLS], int row, int col);
-void check_neighbouring_cells(state a[][MAX_COLS], int row, int col, int* pNum);
-int check_cell_oob(int row, int col);
-void copy_array(state new_arr[][MAX_COLS], state arr[][MAX_COLS]); 
+/* One process's own rows, with halo rows above and below and an 
+empty column down each side, so no cell is checked against the edges. 
+Rows off the top or bottom of the board are left empty */
+struct stripe {
+    int index; 
+    int first_row, num_rows; /* rows of the board it owns */
+    int width; /* cols + 2 */
+    state *cells, *new_cells; /* num_rows + 2 * halo rows of width cells */
+};
 
+typedef struct stripe Stripe;
+
+/* A square of CHUNK_SIZE by CHUNK_SIZE cells of an unbounded plane. 
+Each chunk keeps two generations and flips between them, and links 
+to the (up to 8) chunks around it so their edge cells can be read */
+struct chunk {
+    int chunk_row, chunk_col; /* position of the chunk in the plane */
+    state cells[2][CHUNK_CELLS]; 
+    int current; /* which of cells is this generation */
+    int population; /* non-empty cells */
+    int heads, tails; /* electron heads and tails this generation */
+    int new_heads, new_tails; /* and next generation, once it is stepped */
+    int stepped; /* 1 if the chunk was worked out this generation */
+    struct chunk *neighbours[NUM_NEIGHBOURS]; /* NULL where there is no chunk */
+};
+
+typedef struct chunk Chunk;
+
+/* The plane only has chunks where there are cells, found through a 
+hash table keyed by chunk position. Empty cells never change, so a 
+chunk is only stepped if it, or a chunk next to it, has a signal in 
+it - stretches of plain wire and empty space cost nothing */
+struct plane {
+    Chunk **slots; /* hash table, NULL where a slot is unused */
+    int num_slots; /* a power of 2, at least twice num_chunks */
+    Chunk **chunks; /* every chunk, for stepping */
+    int num_chunks; 
+    Chunk **blocks; /* chunks are allocated CHUNKS_PER_BLOCK at a time */
+    int num_blocks; 
+    /* smallest rectangle holding every non-empty cell */
+    long long min_row, min_col, max_row, max_col; 
+    long long rows, cols; /* size of the file it was read from */
+};
+
+typedef struct plane Plane;
+
+/* a board of any size, as read from a text, RLE or packed file */
+struct board {
+    int rows, cols; 
+    state *cells; /* rows * cols cells, a row at a time */
+    generation gen; /* generation of the cells - 0 unless resuming */
+    /* where the first invalid character of a text file is, if it 
+    could not be loaded */
+    unsigned long error_line, error_column; 
+};
+
+typedef struct board Board;
+
+struct options {
+    char *filename; /* wireworld file to read */
+    int jump; /* JUMP if a generation was given with -g */
+    generation target; /* generation to print when jumping */
+    int engine; /* ENGINE_GRAPH, ENGINE_HASHLIFE, ENGINE_DENSE, ENGINE_SPARSE or ENGINE_DELAY, chosen with -e */
+    int batch; /* BATCH if a number of generations was given with -b */
+    generation batch_gens; /* generations to run without ncurses */
+    generation interval; /* print every interval-th generation, or FINAL_ONLY */
+    char *delta_file; /* file to record a delta stream in with -d, or NULL */
+    generation keyframe_interval; /* frames between keyframes, set with -K */
+    int extract; /* EXTRACT if a frame of a delta stream was asked for with -x */
+    int fps; /* frames drawn per second in the animation, set with -f */
+    char *sweep_file; /* signal injections for each copy with -p, or NULL */
+    char *save_file; /* file the last generation is saved in with -o, or NULL */
+    generation checkpoint; /* save every checkpoint-th generation with -c */
+    char *stats_file; /* file the counters are written to with -s, or NULL */
+    generation stats_interval; /* generations between rows of counters, set with -S */
+    char **probe_specs; /* "row,col" or a probe file for each -P */
+    int num_probe_specs; 
+    char *vcd_file; /* file the probes are written to with -v, or NULL */
+    int benchmark; /* BENCHMARK if -B was given */
+    int benchmark_size; /* biggest circuit to benchmark, in rows and cols */
+    int rule; /* RULE_WIREWORLD, or a variant chosen with -r */
+    int processes; /* stripes run in processes of their own, set with -j */
+    int halo; /* generations between halo exchanges, set with -w */
+};
+
+typedef struct options Options;
+
+/* Counters kept during a batch run, written as a row of CSV (or a 
+JSON object, if the file ends in .json) every interval generations. 
+The populations are of the last generation, the rest are totals 
+since the row before */
+struct stats {
+    FILE *fp; 
+    int json; /* 1 if writing JSON rather than CSV */
+    int engine; 
+    generation interval; 
+    generation cells; /* conductor cells, whatever state they are in */
+    generation heads, tails; /* this generation */
+    generation changed; /* cells which changed state */
+    generation gens; /* generations counted */
+    double step_time, copy_time, render_time; /* in seconds */
+    int rows_written; 
+};
+
+typedef struct stats Stats;
+
+/* A cell whose state is recorded every generation, like a logic 
+analyser's probe on an output pin */
+struct probe {
+    char name[MAX_PROBE_NAME]; 
+    char id[VCD_ID_LENGTH]; /* short code for the probe in the VCD file */
+    long long row, col; 
+    /* conductor number for the graph engine, or board position - 
+    NOT_A_CONDUCTOR if the cell is always empty */
+    long long index; 
+    state value; /* state last recorded */
+};
+
+typedef struct probe Probe;
+
+/* a probe changing state, in the order they happen */
+struct probe_event {
+    generation gen; 
+    int probe; 
+    state value; 
+};
+
+typedef struct probe_event ProbeEvent;
+
+/* Probes are sampled every generation but only their changes are 
+kept, in one buffer for all of them which is written out as a Value 
+Change Dump whenever it fills up. Each probe is a 2 bit signal - 00 
+empty, 01 head, 10 tail and 11 conductor */
+struct probe_set {
+    FILE *fp; /* the VCD file */
+    int engine; 
+    Probe *probes; 
+    int num_probes, capacity; 
+    ProbeEvent *events; 
+    int num_events; 
+    generation time; /* last time written to the file */
+};
+
+typedef struct probe_set ProbeSet;
+
+/* what a Wireworld handle from wireworld.h points to. The board 
+holds the empty cells, and the graph the conductors */
+struct wireworld {
+    Board board; 
+    Graph graph; 
+};
+
+static int find_conductor(Graph *g, int position);
+static int file_format(const char *filename, int *format);
+static int load_board(const char *filename, Board *b);
+static int read_text_board(const char *filename, Board *b);
+static int map_text_file(const char *filename, char **data, size_t *size, int *mapped);
+static size_t find_invalid(const char *data, size_t size);
+static void locate_invalid(const char *data, size_t offset, Board *b);
+static int read_rle(FILE *fp, Board *b);
+static int load_packed(const char *filename, Board *b);
+static generation get_le(unsigned char *bytes, int num_bytes);
+static int check_characters(char c);
+static int is_conductor(state c);
+static int compile_graph(Graph *g, state *board, int rows, int cols, Rule *rule);
+static void step_graph(Graph *g);
+static void step_cells(Graph *g, state *cells, state *new_cells);
+static void step_wireworld(Graph *g, state *cells, state *new_cells);
+static void step_von_neumann(Graph *g, state *cells, state *new_cells);
+static void step_single(Graph *g, state *cells, state *new_cells);
+static void graph_to_array(Graph *g, state *board);
+static void free_graph(Graph *g);
+#ifndef WW_LIBRARY
+static void invalid_argument(char program[]);
+static void parse_arguments(int argc, char **argv, Options *opts);
+static int parse_generation(char *s, generation *g);
+static int parse_engine(char *s, int *engine);
+static void run_batch(Options *opts, Board *b, Graph *g, Plane *p);
+static void write_board(FILE *fp, state *board, int rows, int cols);
+static double seconds_now(void);
+static void run_stripes(Options *opts, Board *b);
+static void run_stripe(StripeSet *ss, Options *opts, Board *b, int index);
+static state *halo_slot(StripeSet *ss, int slot, int stripe, int side);
+static void exchange_halos(StripeSet *ss, Stripe *s, int slot, int *sense);
+static void step_stripe(Stripe *s, int first, int last);
+static void stripe_barrier(StripeHeader *h, int processes, int *sense);
+static void init_probes(ProbeSet *ps, Options *opts, Board *b, Graph *g, Plane *p);
+static void add_probe(ProbeSet *ps, char *name, long long row, long long col, Board *b, Graph *g);
+static void read_probe_file(ProbeSet *ps, char *filename, Board *b, Graph *g);
+static state probe_state(ProbeSet *ps, Probe *pr, Board *b, Graph *g, Plane *p);
+static void sample_probes(ProbeSet *ps, Board *b, Graph *g, Plane *p, generation gen);
+static void write_probe_value(ProbeSet *ps, Probe *pr, state value);
+static void flush_probes(ProbeSet *ps);
+static void close_probes(ProbeSet *ps, generation gen);
+static void run_benchmark(Options *opts);
+static int make_circuit(int circuit, int size, Board *b);
+static double time_engine(int engine, Board *b, generation gens, size_t *memory);
+static void reference_rules(state *cells, state *new_cells, int rows, int cols);
+static void plane_to_board(Plane *p, Board *b);
+static size_t graph_memory(Graph *g);
+#ifdef WW_STATS
+static void open_stats(Stats *s, Options *opts, Board *b, Graph *g, Plane *p);
+static double stats_lap(double *t);
+static void count_signals(Stats *s, Board *b, Graph *g, Plane *p);
+static void stats_generation(Stats *s, Board *b, Graph *g, Plane *p, generation gen, int last);
+static void close_stats(Stats *s);
+#endif
+static void open_delta_stream(DeltaStream *ds, char *filename, Board *b, generation keyframe_interval);
+static void write_delta_frame(DeltaStream *ds, state *board);
+static void close_delta_stream(DeltaStream *ds);
+static void write_varint(FILE *fp, generation n);
+static int read_varint(FILE *fp, generation *n);
+static void extract_frame(char *filename, generation n);
+#ifndef WW_NO_ANIMATION
+static void animate(Graph *g, state *board, int rows, int cols, int fps, NCURS_Simplewin *sw);
+static void init_triple_buffer(TripleBuffer *tb, state *board, int rows, int cols);
+static void free_triple_buffer(TripleBuffer *tb);
+static void publish_frame(TripleBuffer *tb);
+static int take_frame(TripleBuffer *tb);
+static void *simulate(void *arg);
+static void init_dirty_colors(void);
+static void draw_changes(state *shown, state *frame, int rows, int cols, generation gen);
+static void set_colors(NCURS_Simplewin *sw);
+#endif
+static void run_sweep(Options *opts, state *board, int rows, int cols, Graph *g);
+static void init_sliced_graph(SlicedGraph *sg, Graph *g);
+static void read_sweep_file(char *filename, SlicedGraph *sg, int cols);
+static void set_instance_cell(SlicedGraph *sg, int instance, int i, state c);
+static state instance_cell(SlicedGraph *sg, int instance, int i);
+static void step_sliced(SlicedGraph *sg);
+static void free_sliced_graph(SlicedGraph *sg);
+static void init_plane(Plane *p);
+static void free_plane(Plane *p);
+static int read_text_plane(char *filename, Plane *p, Board *b);
+static long long floor_divide(long long a, long long b);
+static unsigned int chunk_hash(int chunk_row, int chunk_col);
+static Chunk *find_chunk(Plane *p, int chunk_row, int chunk_col);
+static Chunk *add_chunk(Plane *p, int chunk_row, int chunk_col);
+static void set_plane_cell(Plane *p, long long row, long long col, state c);
+static state plane_cell(Plane *p, long long row, long long col);
+static int needs_step(Chunk *ch);
+static void step_chunk(Chunk *ch);
+static void step_plane(Plane *p);
+static void write_plane(FILE *fp, Plane *p);
+static void plane_from_board(Plane *p, Board *b);
+static void exit_on_error(int error, Board *b);
+static void pad_board(Board *b, int rows, int cols);
+static void save_board(char *filename, Board *b);
+static void write_rle_run(FILE *fp, int count, char c, int *line_length);
+static void write_rle(FILE *fp, Board *b);
+static void write_packed(FILE *fp, Board *b);
+static void put_le(FILE *fp, generation n, int num_bytes);
+static void add_rules(state arr[][MAX_COLS], state new_arr[][MAX_COLS]);
+static void copy_element(state arr[][MAX_COLS], state new_arr[][MAX_COLS], int row, int col);
+static void apply_rules(state arr[][MAX_COLS], state new_arr[][MAX_COLS], int row, int col);
+static int access_array_oob(state a[][MAX_COLS], int row, int col);
+static int num_electron_heads(state a[][MAX_COLS], int row, int col);
+static void check_neighbouring_cells(state a[][MAX_COLS], int row, int col, int* pNum);
+static int check_cell_oob(int row, int col);
+static void copy_array(state new_arr[][MAX_COLS], state arr[][MAX_COLS]); 
+static void *allocate_memory(size_t size);
+static int parse_rule(char *s, int *rule);
+static unsigned long long cell_key(int i, state c);
+static unsigned long long hash_cells(Graph *g, state *cells);
+static unsigned long long update_hash(Graph *g, state *cells, state *new_cells, unsigned long long hash);
+static int find_cycle(Graph *g, generation target, Cycle *cy);
+static void advance_cells(Graph *g, state *cells, generation n);
+static void cycle_state_at(Graph *g, Cycle *cy, generation n);
+static void free_cycle(Cycle *cy);
+static void jump_to_generation(Graph *g, generation n, Board *b);
+static void hashlife_generation(generation n, Board *b);
+static void hl_write_board(HashLife *h, state *board);
+static int cell_code(state c);
+static void hl_init(HashLife *h, state *board, int rows, int cols);
+static void hl_free(HashLife *h);
+static int hl_new_node(HashLife *h);
+static void hl_rehash(HashLife *h);
+static unsigned int hl_hash(int nw, int ne, int sw, int se);
+static int hl_join(HashLife *h, int nw, int ne, int sw, int se);
+static int hl_empty(HashLife *h, int level);
+static int hl_build(HashLife *h, state *board, int level, long long top, long long left);
+static int hl_centre(HashLife *h, int n);
+static int hl_base_case(HashLife *h, int n);
+static int hl_successor(HashLife *h, int n, int step);
+static void hl_expand(HashLife *h);
+static int hl_board_in_centre(HashLife *h);
+static void hl_step(HashLife *h, int step);
+static void hl_advance(HashLife *h, generation n);
+static void hl_mark(HashLife *h, int n);
+static void hl_collect_garbage(HashLife *h);
+static void hl_free_unreachable(HashLife *h);
+static void hl_to_array(HashLife *h, int n, long long top, long long left, state *board);
+static void delay_init(DelayGraph *d, Graph *g);
+static int is_plain_wire(Graph *g, int i);
+static void add_wire(DelayGraph *d, int *path, int length, int first_end, int last_end, char *placed);
+static void delay_step(DelayGraph *d);
+static void step_wire(WireSegment *w, state *cells, state *new_cells);
+static state wire_cell(lane *heads, lane *tails, int k);
+static void delay_to_array(DelayGraph *d, state *board);
+static size_t delay_memory(DelayGraph *d);
+static void delay_free(DelayGraph *d);
+#endif
+
+/* Wireworld, which counts all 8 cells around a conductor, and two 
+variants - only counting the 4 cells above, below and to the side, 
+and firing on exactly 1 head */
+static Rule rules[NUM_RULES] = {
+    {"wireworld", 8, {-1, -1, -1, 0, 0, 1, 1, 1}, {-1, 0, 1, -1, 1, -1, 0, 1}, step_wireworld}, 
+    {"vonneumann", 4, {-1, 0, 0, 1}, {0, -1, 1, 0}, step_von_neumann}, 
+    {"single", 8, {-1, -1, -1, 0, 0, 1, 1, 1}, {-1, 0, 1, -1, 1, -1, 0, 1}, step_single}
+};
+
+#ifndef WW_LIBRARY
 int main(int argc, char **argv)
 {
 
-    FILE *fp; /* pointer to filename */
-    /* 2D arrays of size 40 by 40 */
-    state wire_world[MAX_ROWS][MAX_COLS]; 
-    state new_wire_world[MAX_ROWS][MAX_COLS];
+    Board board; /* the file's cells, of any size */
+#ifndef WW_NO_ANIMATION
     NCURS_Simplewin sw; /* initialise mouse / keyboard events */
+#endif
+    Graph graph; /* conductor cells of the board and their neighbours */
+    Plane plane; /* the file's cells for the sparse engine */
+    Options opts; /* settings given on the command line */
+    int format; /* FORMAT_TEXT, FORMAT_RLE or FORMAT_PACKED */
 
-    /* if number of arguments passed to terminal is not 2 */
-    invalid_argument(argc, argv[0]); 
+    /* exit if the arguments passed to terminal are not valid */
+    parse_arguments(argc, argv, &opts); 
 
-    /* open file whose title is the second argument entered by the user */
-    if ((fp = fopen(argv[1], "r")) == NULL) {
-        fprintf(stderr, "Error: Cannot open file\n");
-        exit (EXIT_FAILURE); 
+    /* the file is a delta stream rather than a wireworld file */
+    if (opts.extract == EXTRACT) {
+        extract_frame(opts.filename, opts.target);
+        free(opts.probe_specs);
+        exit(EXIT_SUCCESSFUL);
     }
 
-    /* read file and exit if any invalid characters present */    
-    read_file(fp, wire_world);
+    /* the circuits are made rather than read */
+    if (opts.benchmark == BENCHMARK) {
+        run_benchmark(&opts);
+        free(opts.probe_specs);
+        exit(EXIT_SUCCESSFUL);
+    }
 
-    fclose(fp);
+    /* the sparse engine reads text files of any size straight into 
+    its own plane, without a board the size of the whole file */
+    if (opts.engine == ENGINE_SPARSE) {
+        init_plane(&plane);
+        exit_on_error(file_format(opts.filename, &format), NULL);
+        if (format == FORMAT_TEXT) {
+            exit_on_error(read_text_plane(opts.filename, &plane, &board), &board);
+        }
+        else {
+            exit_on_error(load_board(opts.filename, &board), &board);
+            plane_from_board(&plane, &board);
+            free(board.cells);
+        }
+        run_batch(&opts, NULL, NULL, &plane);
+        free_plane(&plane);
+        free(opts.probe_specs);
+        exit(EXIT_SUCCESSFUL);
+    }
+
+    /* read file (text, RLE or a packed checkpoint) and exit if 
+    any invalid characters present */    
+    exit_on_error(load_board(opts.filename, &board), &board);
+
+    /* the original rules only work on a 40 by 40 array, so smaller 
+    boards are padded out to it */
+    if (opts.engine == ENGINE_DENSE && (board.rows > MAX_ROWS || board.cols > MAX_COLS)) {
+        fprintf(stderr, "Error: The dense engine only runs boards up to %d by %d\n", MAX_ROWS, MAX_COLS);
+        exit(EXIT_FAILURE);
+    }
+    if (opts.engine == ENGINE_DENSE) {
+        pad_board(&board, MAX_ROWS, MAX_COLS);
+    }
 
+    /* stripes of the board in processes of their own, with the original rules */
+    if (opts.processes > SINGLE_PROCESS) {
+        run_stripes(&opts, &board);
+        free(board.cells);
+        free(opts.probe_specs);
+        exit(EXIT_SUCCESSFUL);
+    }
+
+    /* extract the conductors once - empty space is never looked at again */
+    exit_on_error(compile_graph(&graph, board.cells, board.rows, board.cols, &rules[opts.rule]), NULL);
+
+    /* run every copy of the circuit in a sweep file together */
+    if (opts.sweep_file != NULL) {
+        run_sweep(&opts, board.cells, board.rows, board.cols, &graph);
+        free_graph(&graph);
+        free(opts.probe_specs);
+        exit(EXIT_SUCCESSFUL);
+    }
+
+    /* run generations without ncurses, printing only what was asked for */
+    if (opts.batch == BATCH) {
+        run_batch(&opts, &board, &graph, NULL);
+        free_graph(&graph);
+        free(opts.probe_specs);
+        exit(EXIT_SUCCESSFUL);
+    }
+
+    /* print a single generation, without running the ones before it */
+    if (opts.jump == JUMP && opts.engine == ENGINE_HASHLIFE) {
+        hashlife_generation(opts.target, &board);
+        free_graph(&graph);
+        free(opts.probe_specs);
+        exit(EXIT_SUCCESSFUL);
+    }
+    if (opts.jump == JUMP) {
+        jump_to_generation(&graph, opts.target, &board);
+        free_graph(&graph);
+        free(opts.probe_specs);
+        exit(EXIT_SUCCESSFUL);
+    }
+
+#ifdef WW_NO_ANIMATION
+    fprintf(stderr, "Error: Built without the animation, so -g or -b is needed\n");
+    exit(EXIT_FAILURE);
+#else
     Neill_NCURS_Init(&sw); 
 
-    /* set colors for states in wire_world */
+    /* set colors for states in the board */
     set_colors(&sw); 
+    init_dirty_colors();
 
-    /*thousand_generations(wire_world, new_wire_world); - part 1 only*/
-
-    /* continues looping until mouse click or ESC key pressed */
-    do {
-        /* print array, apply rules to new_wire_world, and copy 
-        back into original array */
-        Neill_NCURS_PrintArray(&wire_world[0][0], MAX_COLS, MAX_ROWS, &sw);
-        add_rules(wire_world, new_wire_world); 
-        copy_array(new_wire_world, wire_world); 
-        Neill_NCURS_Delay(1000); /* 1 second delay */
-        Neill_NCURS_Events(&sw); /* Wait for mouse click, or ESC key event */
-    } while (!sw.finished); 
+    /* first generation is printed in full, then the simulation runs 
+    on its own thread while only the cells that change are redrawn */
+    Neill_NCURS_PrintArray(board.cells, board.cols, board.rows, &sw);
+    animate(&graph, board.cells, board.rows, board.cols, opts.fps, &sw);
 
     /* Call this function if we exit() anywhere in the code */
     atexit(Neill_NCURS_Done);
 
+    free_graph(&graph);
+    free(board.cells);
+
+    free(opts.probe_specs);
     exit(EXIT_SUCCESSFUL); 
+#endif
 
 } /* end main */
 
-void invalid_argument(int argc, char argv[])
+static void invalid_argument(char program[])
 {
 
-    if (argc != 2) {
-        fprintf(stderr, "Error: Incorrect usage, try e.g. %s wirefile.txt\n", argv);
-        exit(EXIT_FAILURE);
-    }
+    fprintf(stderr, "Error: Incorrect usage, try e.g. %s [-f 10] wirefile.txt\n", program);
+    fprintf(stderr, "       or %s -g 1000000000000 [-e graph|hashlife] wirefile.txt\n", program);
+    fprintf(stderr, "       or %s -b 1000000 [-k 1000] [-e graph|hashlife|dense|delay] "
+        "[-d stream.wwd [-K 256]] [-o save.wwb [-c 10000]] wirefile.txt\n", program);
+    fprintf(stderr, "       or %s -b 1000000 [-k 1000] -e sparse wirefile.txt\n", program);
+    fprintf(stderr, "       or %s -x 1000 stream.wwd\n", program);
+    fprintf(stderr, "       or %s -b 1000000 -p sweep.txt wirefile.txt\n", program);
+    fprintf(stderr, "       or %s -b 1000000 -j 8 [-w 4] [-k 1000] "
+        "[-o save.wwb [-c 10000]] wirefile.txt\n", program);
+    fprintf(stderr, "       or any of the graph engine's modes with -r wireworld|vonneumann|single\n");
+    fprintf(stderr, "       or %s -b 100 -B 16384 [-e graph|hashlife|dense|sparse|delay] "
+        "clock|diode|wire|gates|random|all\n", program);
+    fprintf(stderr, "       or %s -b 1000000 -P probes.txt|row,col [-P ...] -v out.vcd "
+        "[-e graph|hashlife|dense|sparse|delay] wirefile.txt\n", program);
+#ifdef WW_STATS
+    fprintf(stderr, "       or %s -b 1000000 -s stats.csv|stats.json [-S 1000] "
+        "[-e graph|hashlife|dense|sparse|delay] wirefile.txt\n", program);
+#endif
+    exit(EXIT_FAILURE);
 
 } /* end invalid_argument */
 
-void set_colors(NCURS_Simplewin *sw)
+/* The filename is always the last argument, and the options come 
+before it - invalid_argument lists how they combine. "-f" sets the 
+frame rate, "-g n" prints generation n and "-b n" runs n generations 
+without ncurses, on the engine chosen with "-e". "-d" and "-x" write 
+and read delta streams, "-o" and "-c" save checkpoints, "-p" sweeps 
+copies of the circuit, "-j" and "-w" split it into processes, "-P" 
+and "-v" probe cells, "-B" benchmarks, "-r" picks the rules and, 
+with -DWW_STATS, "-s" and "-S" write counters */
+static void parse_arguments(int argc, char **argv, Options *opts)
 {
 
-    /* Function  sets the background color based on specific characters */
-    Neill_NCURS_CharStyle(sw, "t", COLOR_RED, COLOR_RED, A_NORMAL);
-    Neill_NCURS_CharStyle(sw, "c", COLOR_YELLOW, COLOR_YELLOW, A_NORMAL);
-    Neill_NCURS_CharStyle(sw, "H", COLOR_BLUE, COLOR_BLUE, A_NORMAL);
-    Neill_NCURS_CharStyle(sw, " ", COLOR_BLACK, COLOR_BLACK, A_NORMAL);
-    Neill_NCURS_CharStyle(sw, "\n", COLOR_BLACK, COLOR_BLACK, A_NORMAL); 
+    int i, engine_given = 0;
 
-} /* end set_colors */
+    opts->jump = NO_JUMP;
+    opts->target = 0;
+    opts->engine = ENGINE_GRAPH;
+    opts->batch = NO_BATCH;
+    opts->batch_gens = 0;
+    opts->interval = FINAL_ONLY;
+    opts->delta_file = NULL;
+    opts->keyframe_interval = DEFAULT_KEYFRAME_INTERVAL;
+    opts->extract = NO_EXTRACT;
+    opts->fps = DEFAULT_FPS;
+    opts->sweep_file = NULL;
+    opts->save_file = NULL;
+    opts->checkpoint = NO_CHECKPOINTS;
+    opts->stats_file = NULL;
+    opts->stats_interval = 1;
+    opts->probe_specs = (char **)allocate_memory(argc * sizeof(char *));
+    opts->num_probe_specs = 0;
+    opts->vcd_file = NULL;
+    opts->benchmark = NO_BENCHMARK;
+    opts->benchmark_size = 0;
+    opts->rule = RULE_WIREWORLD;
+    opts->processes = SINGLE_PROCESS;
+    opts->halo = DEFAULT_HALO;
+
+    for (i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "-g") == 0 && i + 1 < argc - 1 && 
+            parse_generation(argv[i + 1], &opts->target) == VALID) {
+            opts->jump = JUMP;
+            i++;
+        }
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc - 1 && 
+            parse_generation(argv[i + 1], &opts->batch_gens) == VALID) {
+            opts->batch = BATCH;
+            i++;
+        }
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc - 1) {
+            opts->sweep_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc - 1) {
+            opts->save_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc - 1 && 
+            parse_generation(argv[i + 1], &opts->checkpoint) == VALID) {
+            i++;
+        }
+#ifdef WW_STATS
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc - 1) {
+            opts->stats_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc - 1 && 
+            parse_generation(argv[i + 1], &opts->stats_interval) == VALID && 
+            opts->stats_interval > 0) {
+            i++;
+        }
+#endif
+        else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc - 1) {
+            opts->probe_specs[opts->num_probe_specs++] = argv[++i];
+        }
+        else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc - 1) {
+            opts->vcd_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc - 1) {
+            opts->delta_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "-K") == 0 && i + 1 < argc - 1 && 
+            parse_generation(argv[i + 1], &opts->keyframe_interval) == VALID && 
+            opts->keyframe_interval > 0) {
+            i++;
+        }
+        else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc - 1 && 
+            parse_generation(argv[i + 1], &opts->target) == VALID) {
+            opts->extract = EXTRACT;
+            i++;
+        }
+        else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc - 1 && 
+            (opts->fps = atoi(argv[i + 1])) > 0 && opts->fps <= MILLISECONDS) {
+            i++;
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc - 1 && 
+            (opts->processes = atoi(argv[i + 1])) > 0) {
+            i++;
+        }
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc - 1 && 
+            (opts->halo = atoi(argv[i + 1])) > 0) {
+            i++;
+        }
+        else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc - 1 && 
+            parse_generation(argv[i + 1], &opts->interval) == VALID) {
+            i++;
+        }
+        else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc - 1 && 
+            parse_engine(argv[i + 1], &opts->engine) == VALID) {
+            engine_given = 1;
+            i++;
+        }
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc - 1 && 
+            parse_rule(argv[i + 1], &opts->rule) == VALID) {
+            i++;
+        }
+        else if (strcmp(argv[i], "-B") == 0 && i + 1 < argc - 1 && 
+            (opts->benchmark_size = atoi(argv[i + 1])) >= MAX_ROWS && 
+            opts->benchmark_size <= MAX_BENCHMARK_SIZE) {
+            opts->benchmark = BENCHMARK;
+            i++;
+        }
+        else {
+            invalid_argument(argv[0]);
+        }
+    }
+
+    /* a sweep has to be told how many generations to run, and only 
+    prints the last one from its own engine, with nothing saved. The 
+    sparse engine only runs batches without a delta stream or saves, 
+    the delay engine only runs batches, stripes only run batches of 
+    the original rules with nothing but boards and saves out, only 
+    the graph engine has the variant rules, checkpoints need a file 
+    to go in, and counters and probes need a batch. -g and -b can't 
+    be mixed, -g only has the graph and HashLife engines, and the 
+    animation has no choice of engine */
+    if (argc < 2 || argv[argc - 1][0] == '-' || 
+        (opts->jump == JUMP && opts->batch == BATCH) || 
+        (opts->jump == JUMP && opts->engine != ENGINE_GRAPH && opts->engine != ENGINE_HASHLIFE) || 
+        (engine_given && opts->jump != JUMP && opts->batch != BATCH) || 
+        (opts->sweep_file != NULL && (opts->batch != BATCH || engine_given || 
+        opts->interval != FINAL_ONLY || opts->save_file != NULL || opts->delta_file != NULL)) || 
+        (opts->engine == ENGINE_SPARSE && (opts->batch != BATCH || 
+        opts->delta_file != NULL || opts->sweep_file != NULL || opts->save_file != NULL)) || 
+        (opts->engine == ENGINE_DELAY && (opts->batch != BATCH || opts->sweep_file != NULL)) || 
+        (opts->processes > SINGLE_PROCESS && (opts->batch != BATCH || engine_given || 
+        opts->rule != RULE_WIREWORLD || opts->delta_file != NULL || opts->sweep_file != NULL || 
+        opts->stats_file != NULL || opts->vcd_file != NULL || opts->benchmark == BENCHMARK)) || 
+        (opts->checkpoint != NO_CHECKPOINTS && opts->save_file == NULL) || 
+        (opts->stats_file != NULL && (opts->batch != BATCH || opts->sweep_file != NULL)) || 
+        ((opts->vcd_file != NULL) != (opts->num_probe_specs > 0)) || 
+        (opts->vcd_file != NULL && (opts->batch != BATCH || opts->sweep_file != NULL)) || 
+        (opts->benchmark == BENCHMARK && (opts->batch != BATCH || opts->interval != FINAL_ONLY || 
+        opts->delta_file != NULL || opts->sweep_file != NULL || opts->save_file != NULL || 
+        opts->stats_file != NULL || opts->vcd_file != NULL)) || 
+        (opts->rule != RULE_WIREWORLD && (opts->engine != ENGINE_GRAPH || 
+        opts->sweep_file != NULL || opts->benchmark == BENCHMARK))) {
+        invalid_argument(argv[0]);
+    }
+    /* a benchmark runs every engine unless it is given one */
+    if (opts->benchmark == BENCHMARK && !engine_given) {
+        opts->engine = ENGINE_ALL;
+    }
+    opts->filename = argv[argc - 1];
 
-void read_file(FILE *fp, state arr[][MAX_COLS])
+} /* end parse_arguments */
+
+/* reads a generation number, which must be only digits */
+static int parse_generation(char *s, generation *g)
 {
 
-    int i, j; 
-    char c; /* characters read in by file */
-    i = 0;
+    char *end;
 
-    while (i < MAX_ROWS) {
-        j = 0;
-        /* add characters to arr while not EOF.
-        Go to second column of array when j is 40 */
-        while (((c = getc(fp)) != EOF) && (j < MAX_COLS)) {
-            arr[i][j] = c; 
-            /* exit program if invalid characters found in file */
-            if (check_characters(c) == INVALID) {
-                fprintf(stderr, "Error: Invalid character in file\n");
-                exit(EXIT_FAILURE); 
-            }
-            j++; 
-        }
-        i++;
+    if (s[0] < '0' || s[0] > '9') {
+        return INVALID;
     }
+    *g = strtoull(s, &end, 10);
 
-} /* end read_file */
+    return (*end == '\0') ? VALID : INVALID;
 
-/* checks to see if any characters bar ' ', 't', 'H'
-'c', '\n' or EOF are present in the file */
-int check_characters(char c)
+} /* end parse_generation */
+
+static int parse_engine(char *s, int *engine)
 {
 
-    if (VALID_CHARACTERS) {
-        return VALID; 
+    if (strcmp(s, "graph") == 0) {
+        *engine = ENGINE_GRAPH;
+    }
+    else if (strcmp(s, "hashlife") == 0) {
+        *engine = ENGINE_HASHLIFE;
+    }
+    else if (strcmp(s, "dense") == 0) {
+        *engine = ENGINE_DENSE;
+    }
+    else if (strcmp(s, "sparse") == 0) {
+        *engine = ENGINE_SPARSE;
+    }
+    else if (strcmp(s, "delay") == 0) {
+        *engine = ENGINE_DELAY;
     }
     else {
-        return INVALID; 
+        return INVALID;
     }
 
-} /* end check_characters */
+    return VALID;
 
-void thousand_generations(state arr[][MAX_COLS], state new_arr[][MAX_COLS])
+} /* end parse_engine */
+
+static int parse_rule(char *s, int *rule)
 {
 
-    int i; 
+    int i;
+
+    for (i = 0; i < NUM_RULES; i++) {
+        if (strcmp(s, rules[i].name) == 0) {
+            *rule = i;
+            return VALID;
+        }
+    }
+
+    return INVALID;
+
+} /* end parse_rule */
 
-    /* runs through 500 times to give 1000 wireworld boards */
-    for (i = 0; i < END_ITERATION; i++) {
-        printArray(arr); 
+/* Runs opts->batch_gens generations with the chosen engine and 
+writes the last one (or every opts->interval-th one) to stdout. The 
+time taken and the number of cells updated per second are written 
+to stderr, so a batch job's output is just the boards */
+static void run_batch(Options *opts, Board *b, Graph *g, Plane *p)
+{
 
-        /* add rules and put contents in new array*/
-        add_rules(arr, new_arr);
-        /* copy contents back into original array */
-        copy_array(new_arr, arr); 
+    HashLife h;
+    DelayGraph d;
+    DeltaStream ds;
+    ProbeSet ps;
+    state new_arr[MAX_ROWS][MAX_COLS]; /* next generation for the dense engine */
+    generation done, chunk, i, start_gen;
+    double start, sim_time, tick, wall_time, cells; 
+    int frames = 0;
+#ifdef WW_STATS
+    Stats stats; 
+    double lap; /* when the phase being timed started */
+#endif
 
+    setvbuf(stdout, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+    if (opts->engine == ENGINE_HASHLIFE) {
+        hl_init(&h, b->cells, b->rows, b->cols);
+    }
+    else if (opts->engine == ENGINE_DELAY) {
+        delay_init(&d, g);
+    }
+    if (opts->delta_file != NULL) {
+        open_delta_stream(&ds, opts->delta_file, b, opts->keyframe_interval);
+        write_delta_frame(&ds, b->cells);
+    }
+    if (opts->stats_file != NULL) {
+        STATS_OPEN(stats, opts, b, g, p);
+    }
+    if (opts->vcd_file != NULL) {
+        init_probes(&ps, opts, b, g, p);
     }
 
-} /* end thousand_generations */
+    start = seconds_now();
+    sim_time = 0;
+    done = 0;
+    start_gen = (b != NULL) ? b->gen : 0;
+    while (done < opts->batch_gens) {
+        chunk = opts->batch_gens - done;
+        if (opts->interval != FINAL_ONLY && opts->interval - done % opts->interval < chunk) {
+            chunk = opts->interval - done % opts->interval;
+        }
+        if (opts->checkpoint != NO_CHECKPOINTS && opts->checkpoint - done % opts->checkpoint < chunk) {
+            chunk = opts->checkpoint - done % opts->checkpoint;
+        }
+        /* every generation goes into a delta stream, is counted and 
+        has its probes sampled */
+        if (opts->delta_file != NULL || opts->stats_file != NULL || opts->vcd_file != NULL) {
+            chunk = 1;
+        }
 
-void printArray(state arr[][MAX_COLS])
-{
+        tick = seconds_now();
+        STATS_START(lap);
+        if (opts->engine == ENGINE_HASHLIFE) {
+            hl_advance(&h, chunk);
+        }
+        else if (opts->engine == ENGINE_DENSE) {
+            for (i = 0; i < chunk; i++) {
+                add_rules((state (*)[MAX_COLS])b->cells, new_arr);
+                STATS_LAP(stats, step_time, lap);
+                copy_array(new_arr, (state (*)[MAX_COLS])b->cells);
+                STATS_LAP(stats, copy_time, lap);
+            }
+        }
+        else if (opts->engine == ENGINE_SPARSE) {
+            for (i = 0; i < chunk; i++) {
+                step_plane(p);
+            }
+        }
+        else if (opts->engine == ENGINE_DELAY) {
+            for (i = 0; i < chunk; i++) {
+                delay_step(&d);
+            }
+        }
+        else {
+            for (i = 0; i < chunk; i++) {
+                step_graph(g);
+            }
+        }
+        STATS_LAP(stats, step_time, lap);
+        sim_time += seconds_now() - tick;
+        done += chunk;
 
-    int row, col;  
-    
-    for (row = 0; row < MAX_ROWS; row++) {
-        for (col = 0; col < MAX_COLS; col++) {
-            printf("%c", arr[row][col]); 
+        /* only engines which keep their own cells need writing back */
+        if (opts->engine != ENGINE_SPARSE && (opts->delta_file != NULL || 
+            ((opts->engine == ENGINE_HASHLIFE || opts->engine == ENGINE_DELAY) && 
+            (opts->stats_file != NULL || opts->vcd_file != NULL)) || 
+            (opts->interval != FINAL_ONLY && done % opts->interval == 0) || 
+            (opts->checkpoint != NO_CHECKPOINTS && done % opts->checkpoint == 0) || 
+            done == opts->batch_gens)) {
+            if (opts->engine == ENGINE_HASHLIFE) {
+                hl_write_board(&h, b->cells);
+            }
+            else if (opts->engine == ENGINE_DELAY) {
+                delay_to_array(&d, b->cells);
+            }
+            else if (opts->engine == ENGINE_GRAPH) {
+                graph_to_array(g, b->cells);
+            }
+        }
+        STATS_LAP(stats, copy_time, lap);
+        if (opts->vcd_file != NULL) {
+            sample_probes(&ps, b, g, p, start_gen + done);
+        }
+        if (opts->delta_file != NULL) {
+            write_delta_frame(&ds, b->cells);
+        }
+        if (opts->checkpoint != NO_CHECKPOINTS && done % opts->checkpoint == 0 && 
+            done != opts->batch_gens) {
+            b->gen = start_gen + done;
+            save_board(opts->save_file, b);
         }
-        PRINT_NEWLINE; 
+        if ((opts->interval != FINAL_ONLY && done % opts->interval == 0) || 
+            done == opts->batch_gens) {
+            /* boards are separated by a blank line */
+            if (frames++ > 0) {
+                putchar('\n');
+            }
+            if (opts->engine == ENGINE_SPARSE) {
+                write_plane(stdout, p);
+            }
+            else {
+                write_board(stdout, b->cells, b->rows, b->cols);
+            }
+        }
+        STATS_LAP(stats, render_time, lap);
+        if (opts->stats_file != NULL) {
+            STATS_GENERATION(stats, b, g, p, start_gen + done, done == opts->batch_gens);
+        }
+    }
+    /* no generations asked for, so the board is printed as read */
+    if (opts->batch_gens == 0 && opts->engine == ENGINE_SPARSE) {
+        write_plane(stdout, p);
+    }
+    else if (opts->batch_gens == 0) {
+        write_board(stdout, b->cells, b->rows, b->cols);
+    }
+    fflush(stdout);
+    if (opts->save_file != NULL) {
+        b->gen = start_gen + opts->batch_gens;
+        save_board(opts->save_file, b);
+    }
+    wall_time = seconds_now() - start;
+
+    fprintf(stderr, "%llu generations in %.3f s (%.3f s simulating)\n", 
+        opts->batch_gens, wall_time, sim_time);
+    if (opts->engine == ENGINE_SPARSE) {
+        cells = (double)(p->max_row - p->min_row + 1) * (p->max_col - p->min_col + 1);
+    }
+    else {
+        cells = (double)b->rows * b->cols;
+    }
+    if (sim_time > 0 && opts->engine == ENGINE_SPARSE) {
+        fprintf(stderr, "%.4g cell updates/sec over %d chunks\n", 
+            cells * opts->batch_gens / sim_time, p->num_chunks);
+    }
+    else if (sim_time > 0) {
+        fprintf(stderr, "%.4g cell updates/sec\n", cells * opts->batch_gens / sim_time);
+    }
+
+    if (opts->engine == ENGINE_HASHLIFE) {
+        hl_free(&h);
+    }
+    else if (opts->engine == ENGINE_DELAY) {
+        delay_free(&d);
+    }
+    if (opts->delta_file != NULL) {
+        close_delta_stream(&ds);
+    }
+    if (opts->stats_file != NULL) {
+        STATS_CLOSE(stats);
+    }
+    if (opts->vcd_file != NULL) {
+        close_probes(&ps, start_gen + opts->batch_gens);
     }
 
-} /* end printArray */
+} /* end run_batch */
 
-void add_rules(state arr[][MAX_COLS], state new_arr[][MAX_COLS])
+/* writes a board a row at a time rather than a character at a time */
+static void write_board(FILE *fp, state *board, int rows, int cols)
 {
 
-    int row, col;
+    int row;
 
-    /* copies entire board over to a new array, then 
-    changes the  characters in array based on rules set */
-    for (row = 0; row < MAX_ROWS; row++) {
-        for (col = 0; col < MAX_COLS; col++) {
-            copy_element(arr, new_arr, row, col);
-            apply_rules(arr, new_arr, row, col); 
-        }
+    for (row = 0; row < rows; row++) {
+        fwrite(board + (size_t)row * cols, 1, cols, fp);
+        putc('\n', fp);
     }
 
-} /* end add_rules */
+} /* end write_board */
 
-void copy_element(state arr[][MAX_COLS], state new_arr[][MAX_COLS], int row, int col)
+/* wall clock time in seconds, for timing batch runs */
+static double seconds_now(void)
 {
 
-    new_arr[row][col] = arr[row][col]; 
+    struct timespec ts;
 
-} /* end copy_array */
+    clock_gettime(CLOCK_MONOTONIC, &ts);
 
-void apply_rules(state arr[][MAX_COLS], state new_arr[][MAX_COLS], int row, int col)
+    return ts.tv_sec + ts.tv_nsec / NANOSECONDS;
+
+} /* end seconds_now */
+
+/* Sets up the probes given with -P and starts the VCD file, with the 
+probes' states at the start of the run */
+static void init_probes(ProbeSet *ps, Options *opts, Board *b, Graph *g, Plane *p)
 {
 
-    /* access_array_oob returns arr[row][col] if elements are 
-    within the array */
-    if (access_array_oob(arr, row, col) == ELECTRON_HEAD) {
-        new_arr[row][col] = ELECTRON_TAIL; 
-    }
-    else if (access_array_oob(arr, row, col) == ELECTRON_TAIL) {
-        new_arr[row][col] = CONDUCTOR;
+    char name[MAX_PROBE_NAME], end;
+    long long row, col;
+    int i, n, j;
+    Probe *pr;
+
+    ps->engine = opts->engine;
+    ps->capacity = INITIAL_PROBES;
+    ps->probes = (Probe *)allocate_memory(ps->capacity * sizeof(Probe));
+    ps->num_probes = 0;
+    ps->events = (ProbeEvent *)allocate_memory(PROBE_BUFFER * sizeof(ProbeEvent));
+    ps->num_events = 0;
+    ps->time = (b != NULL) ? b->gen : 0;
+
+    for (i = 0; i < opts->num_probe_specs; i++) {
+        if (sscanf(opts->probe_specs[i], "%lld,%lld%c", &row, &col, &end) == 2) {
+            sprintf(name, "cell_%lld_%lld", row, col);
+            add_probe(ps, name, row, col, b, g);
+        }
+        else {
+            read_probe_file(ps, opts->probe_specs[i], b, g);
+        }
     }
-    else if (access_array_oob(arr, row, col) == EMPTY) {
-        new_arr[row][col] = EMPTY;
+
+    if ((ps->fp = fopen(opts->vcd_file, "w")) == NULL) {
+        fprintf(stderr, "Error: Cannot open VCD file\n");
+        exit(EXIT_FAILURE);
     }
-    else if (access_array_oob(arr, row, col) == CONDUCTOR) {
-        /* If number electron heads is 1 or 2, 'c' becomes 'H' */
-        if (num_electron_heads(arr, row, col) == CORRECT_NUM) {
-            new_arr[row][col] = ELECTRON_HEAD; 
-        }
-        else { /* no change */
-            new_arr[row][col] = CONDUCTOR;
+    fprintf(ps->fp, "$version wireworld $end\n");
+    fprintf(ps->fp, "$comment one time step is one generation $end\n");
+    fprintf(ps->fp, "$timescale 1 ns $end\n");
+    fprintf(ps->fp, "$scope module circuit $end\n");
+    for (i = 0; i < ps->num_probes; i++) {
+        /* ids are base 94 numbers in the printable characters */
+        pr = &ps->probes[i];
+        for (n = i, j = 0; j == 0 || n > 0; n /= VCD_ID_CHARS) {
+            pr->id[j++] = (char)(VCD_FIRST_ID + n % VCD_ID_CHARS);
         }
+        pr->id[j] = '\0';
+        fprintf(ps->fp, "$var wire %d %s %s $end\n", VCD_BITS, pr->id, pr->name);
     }
-    else {
-        new_arr[row][col] = arr[row][col]; 
+    fprintf(ps->fp, "$upscope $end\n");
+    fprintf(ps->fp, "$enddefinitions $end\n");
+
+    fprintf(ps->fp, "#%llu\n$dumpvars\n", ps->time);
+    for (i = 0; i < ps->num_probes; i++) {
+        pr = &ps->probes[i];
+        pr->value = probe_state(ps, pr, b, g, p);
+        write_probe_value(ps, pr, pr->value);
     }
+    fprintf(ps->fp, "$end\n");
 
-} /* end apply_rules */
+} /* end init_probes */
 
-/* Will exit the program if, for some reason, the array was 
-accessed out of bounds, i.e. < 0 or > 40 */
-int access_array_oob(state a[][MAX_COLS], int row, int col)
+/* adds a probe, working out where its cell is kept */
+static void add_probe(ProbeSet *ps, char *name, long long row, long long col, Board *b, Graph *g)
 {
 
-    /* exits program if array goes out of bounds, otherwise returns
-    the element of the 2D arary */
-    if ((col < 0) ||  (row < 0) || (col >= MAX_COLS) || (row >= MAX_ROWS)) {
-        fprintf(stderr, "Error: accessed an array out of bounds\n");
-        exit (EXIT_FAILURE); 
+    Probe *pr;
+
+    /* the sparse engine has no edges to fall off */
+    if (ps->engine != ENGINE_SPARSE && 
+        (row < 0 || col < 0 || row >= b->rows || col >= b->cols)) {
+        fprintf(stderr, "Error: Probe %s is off the board\n", name);
+        exit(EXIT_FAILURE);
     }
-    else {
-        return a[row][col]; 
+
+    if (ps->num_probes == ps->capacity) {
+        ps->capacity *= 2;
+        if ((ps->probes = (Probe *)realloc(ps->probes, ps->capacity * sizeof(Probe))) == NULL) {
+            fprintf(stderr, "Error: Cannot allocate memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    pr = &ps->probes[ps->num_probes++];
+    strncpy(pr->name, name, MAX_PROBE_NAME - 1);
+    pr->name[MAX_PROBE_NAME - 1] = '\0';
+    pr->row = row;
+    pr->col = col;
+    if (ps->engine == ENGINE_GRAPH) {
+        pr->index = find_conductor(g, (int)(row * b->cols + col));
+    }
+    else if (ps->engine != ENGINE_SPARSE) {
+        pr->index = row * b->cols + col;
     }
 
-} /* end access_array_oob */
+} /* end add_probe */
 
-int num_electron_heads(state a[][MAX_COLS], int row, int col)
+/* Each line of a probe file is a name and a cell, such as 
+"carry_out 12,30". Blank lines and lines starting with '#' are 
+skipped */
+static void read_probe_file(ProbeSet *ps, char *filename, Board *b, Graph *g)
 {
 
-    int num_heads; /* number of electron heads */
-
-    /* check the 8 neighbouring cells against the current cell */
-    check_neighbouring_cells(a, row, col, &num_heads);
+    FILE *fp;
+    char line[MAX_LINE], name[MAX_PROBE_NAME];
+    long long row, col;
 
-    if (num_heads == 1 || num_heads == 2) {
-        return 1; /* changes 'c' to 'H' */
+    if ((fp = fopen(filename, "r")) == NULL) {
+        fprintf(stderr, "Error: Cannot open probe file\n");
+        exit(EXIT_FAILURE);
     }
-    else {
-        return 0; /* no change */
+
+    while (fgets(line, MAX_LINE, fp) != NULL) {
+        if (line[0] == '#' || strspn(line, " \t\r\n") == strlen(line)) {
+            continue;
+        }
+        if (sscanf(line, "%63s %lld,%lld", name, &row, &col) != 3) {
+            fprintf(stderr, "Error: Invalid probe \"%s\" in probe file\n", strtok(line, "\r\n"));
+            exit(EXIT_FAILURE);
+        }
+        add_probe(ps, name, row, col, b, g);
     }
 
-} /* end num_electron_heads */
+    fclose(fp);
 
-/* This function will check the 8 neighbouring cells of a[r][c].
-If the cells being checked are out of bounds, or is the cell 
-itself, it will be ignored */
-void check_neighbouring_cells(state a[][MAX_COLS], int row, int col, int* pNum)
-{
+} /* end read_probe_file */
 
-    int i, j; 
+/* the state of a probe's cell, from wherever the engine keeps it */
+static state probe_state(ProbeSet *ps, Probe *pr, Board *b, Graph *g, Plane *p)
+{
+
+    if (ps->engine == ENGINE_SPARSE) {
+        return plane_cell(p, pr->row, pr->col);
+    }
+    else if (pr->index == NOT_A_CONDUCTOR) {
+        return EMPTY;
+    }
+    else if (ps->engine == ENGINE_GRAPH) {
+        return g->cells[pr->index];
+    }
+    else {
+        return b->cells[pr->index];
+    }
+
+} /* end probe_state */
+
+/* records the probes which have changed since the last generation */
+static void sample_probes(ProbeSet *ps, Board *b, Graph *g, Plane *p, generation gen)
+{
+
+    int i;
+    state value;
+    ProbeEvent *e;
+
+    for (i = 0; i < ps->num_probes; i++) {
+        if ((value = probe_state(ps, &ps->probes[i], b, g, p)) == ps->probes[i].value) {
+            continue;
+        }
+        if (ps->num_events == PROBE_BUFFER) {
+            flush_probes(ps);
+        }
+        e = &ps->events[ps->num_events++];
+        e->gen = gen;
+        e->probe = i;
+        e->value = value;
+        ps->probes[i].value = value;
+    }
+
+} /* end sample_probes */
+
+static void write_probe_value(ProbeSet *ps, Probe *pr, state value)
+{
+
+    int code = cell_code(value);
+
+    fprintf(ps->fp, "b%d%d %s\n", (code >> 1) & 1, code & 1, pr->id);
+
+} /* end write_probe_value */
+
+/* writes the buffered changes, with a time before each generation's */
+static void flush_probes(ProbeSet *ps)
+{
+
+    int i;
+    ProbeEvent *e;
+
+    for (i = 0; i < ps->num_events; i++) {
+        e = &ps->events[i];
+        if (e->gen != ps->time) {
+            fprintf(ps->fp, "#%llu\n", e->gen);
+            ps->time = e->gen;
+        }
+        write_probe_value(ps, &ps->probes[e->probe], e->value);
+    }
+    ps->num_events = 0;
+
+} /* end flush_probes */
+
+/* writes what is left and a final time, so viewers show the whole 
+run even if nothing changed at the end */
+static void close_probes(ProbeSet *ps, generation gen)
+{
+
+    flush_probes(ps);
+    if (gen != ps->time) {
+        fprintf(ps->fp, "#%llu\n", gen);
+    }
+    if (fclose(ps->fp) != 0) {
+        fprintf(stderr, "Error: Cannot write VCD file\n");
+        exit(EXIT_FAILURE);
+    }
+    free(ps->probes);
+    free(ps->events);
+
+} /* end close_probes */
+
+#ifdef WW_STATS
+/* Opens the counters file and counts the conductors, and the signals 
+in the first generation. Every cell that isn't empty is a conductor 
+cell, so their number never changes */
+static void open_stats(Stats *s, Options *opts, Board *b, Graph *g, Plane *p)
+{
+
+    size_t length;
+    int i;
+
+    if ((s->fp = fopen(opts->stats_file, "w")) == NULL) {
+        fprintf(stderr, "Error: Cannot open stats file\n");
+        exit(EXIT_FAILURE);
+    }
+    length = strlen(opts->stats_file);
+    s->json = (length >= strlen(JSON_EXTENSION) && 
+        strcmp(opts->stats_file + length - strlen(JSON_EXTENSION), JSON_EXTENSION) == 0);
+    s->engine = opts->engine;
+    s->interval = opts->stats_interval;
+    s->changed = s->gens = 0;
+    s->step_time = s->copy_time = s->render_time = 0;
+    s->rows_written = 0;
+
+    if (opts->engine == ENGINE_SPARSE) {
+        s->cells = 0;
+        for (i = 0; i < p->num_chunks; i++) {
+            s->cells += p->chunks[i]->population;
+        }
+    }
+    else {
+        s->cells = g->num_cells;
+    }
+    count_signals(s, b, g, p);
+
+    if (s->json) {
+        fputs("[\n", s->fp);
+    }
+    else {
+        fputs("generation,heads,tails,conductors,changed,step_us,copy_us,render_us\n", s->fp);
+    }
+
+} /* end open_stats */
+
+/* seconds since *t, which is moved on to now */
+static double stats_lap(double *t)
+{
+
+    double now = seconds_now(), elapsed;
+
+    elapsed = now - *t;
+    *t = now;
+
+    return elapsed;
+
+} /* end stats_lap */
+
+/* counts the heads and tails of the current generation, from 
+wherever the engine keeps its cells */
+static void count_signals(Stats *s, Board *b, Graph *g, Plane *p)
+{
+
+    state *cells;
+    size_t n, i;
+    int j;
+
+    s->heads = s->tails = 0;
+    if (s->engine == ENGINE_SPARSE) {
+        for (j = 0; j < p->num_chunks; j++) {
+            s->heads += p->chunks[j]->heads;
+            s->tails += p->chunks[j]->tails;
+        }
+        return;
+    }
+
+    if (s->engine == ENGINE_GRAPH) {
+        cells = g->cells;
+        n = g->num_cells;
+    }
+    else {
+        cells = b->cells;
+        n = (size_t)b->rows * b->cols;
+    }
+    for (i = 0; i < n; i++) {
+        if (cells[i] == ELECTRON_HEAD) {
+            s->heads++;
+        }
+        else if (cells[i] == ELECTRON_TAIL) {
+            s->tails++;
+        }
+    }
+
+} /* end count_signals */
+
+/* Counts a generation that has just been worked out, and writes a 
+row if it is the interval-th since the last one (or the last of the 
+run). Every head becomes a tail, every tail a conductor, and every 
+new head was a conductor, so the cells which changed are the heads 
+and tails before plus the heads after */
+static void stats_generation(Stats *s, Board *b, Graph *g, Plane *p, generation gen, int last)
+{
+
+    generation before;
+
+    before = s->heads + s->tails;
+    count_signals(s, b, g, p);
+    s->changed += before + s->heads;
+    s->gens++;
+    if (s->gens < s->interval && !last) {
+        return;
+    }
+
+    if (s->json) {
+        fprintf(s->fp, "%s{\"generation\": %llu, \"heads\": %llu, \"tails\": %llu, "
+            "\"conductors\": %llu, \"changed\": %llu, \"step_us\": %.3f, "
+            "\"copy_us\": %.3f, \"render_us\": %.3f}", s->rows_written > 0 ? ",\n" : "", 
+            gen, s->heads, s->tails, s->cells - s->heads - s->tails, s->changed, 
+            s->step_time * MICROSECONDS / s->gens, s->copy_time * MICROSECONDS / s->gens, 
+            s->render_time * MICROSECONDS / s->gens);
+    }
+    else {
+        fprintf(s->fp, "%llu,%llu,%llu,%llu,%llu,%.3f,%.3f,%.3f\n", 
+            gen, s->heads, s->tails, s->cells - s->heads - s->tails, s->changed, 
+            s->step_time * MICROSECONDS / s->gens, s->copy_time * MICROSECONDS / s->gens, 
+            s->render_time * MICROSECONDS / s->gens);
+    }
+    s->rows_written++;
+    s->changed = s->gens = 0;
+    s->step_time = s->copy_time = s->render_time = 0;
+
+} /* end stats_generation */
+
+static void close_stats(Stats *s)
+{
+
+    if (s->json) {
+        fputs(s->rows_written > 0 ? "\n]\n" : "]\n", s->fp);
+    }
+    if (fclose(s->fp) != 0) {
+        fprintf(stderr, "Error: Cannot write stats file\n");
+        exit(EXIT_FAILURE);
+    }
+
+} /* end close_stats */
+#endif
+
+/* Times each engine on made up circuits of each size from 40 by 40 
+up to opts->benchmark_size, doubling from FIRST_BENCHMARK_SIZE. The 
+"vs linear" column is the time per cell compared with the size 
+before - about 1 if the engine scales linearly with the board. The 
+final cells are checked against the original rules (add_rules at 
+40 by 40, reference_rules above that) while that takes less than 
+MAX_REFERENCE_WORK cell updates, and against the first engine's 
+result after that. It fails if any engine differs, so "make check" 
+can run it */
+static void run_benchmark(Options *opts)
+{
+
+    static const char *circuits[] = {"clock", "diode", "wire", "gates", "random"};
+    static const char *engines[] = {"graph", "hashlife", "dense", "sparse", "delay"};
+    double seconds, last_time[NUM_ENGINES], last_cells, cells;
+    size_t memory;
+    Board board, result, check;
+    state new_arr[MAX_ROWS][MAX_COLS];
+    state *new_cells, *temp;
+    const char *outcome;
+    int circuit, size, engine, checked, first, differ;
+    generation i;
+
+    for (circuit = 0; circuit < NUM_CIRCUITS; circuit++) {
+        if (strcmp(opts->filename, circuits[circuit]) == 0) {
+            break;
+        }
+    }
+    if (circuit == NUM_CIRCUITS && strcmp(opts->filename, "all") != 0) {
+        fprintf(stderr, "Error: Unknown circuit %s\n", opts->filename);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%-8s %6s %-9s %12s %10s %14s %12s %10s  %s\n", "circuit", "size", "engine", 
+        "cells", "seconds", "updates/sec", "memory KB", "vs linear", "final cells");
+    differ = 0;
+    for (circuit = (circuit == NUM_CIRCUITS) ? 0 : circuit; circuit < NUM_CIRCUITS; circuit++) {
+        last_cells = 0;
+        for (size = MAX_ROWS; size <= opts->benchmark_size; 
+            size = (size < FIRST_BENCHMARK_SIZE) ? FIRST_BENCHMARK_SIZE : size * 2) {
+            exit_on_error(make_circuit(circuit, size, &board), NULL);
+            cells = (double)size * size;
+
+            /* the answer every engine should get */
+            checked = (cells * opts->batch_gens <= MAX_REFERENCE_WORK);
+            check = board;
+            if (checked) {
+                check.cells = (state *)allocate_memory((size_t)size * size);
+                memcpy(check.cells, board.cells, (size_t)size * size);
+                new_cells = (state *)allocate_memory((size_t)size * size);
+                for (i = 0; i < opts->batch_gens; i++) {
+                    if (size == MAX_ROWS) {
+                        add_rules((state (*)[MAX_COLS])check.cells, new_arr);
+                        copy_array(new_arr, (state (*)[MAX_COLS])check.cells);
+                    }
+                    else {
+                        reference_rules(check.cells, new_cells, size, size);
+                        temp = check.cells;
+                        check.cells = new_cells;
+                        new_cells = temp;
+                    }
+                }
+                free(new_cells);
+            }
+
+            first = 1;
+            for (engine = 0; engine < NUM_ENGINES; engine++) {
+                /* the dense engine only has the original 40 by 40 array */
+                if ((opts->engine != ENGINE_ALL && engine != opts->engine) || 
+                    (engine == ENGINE_DENSE && size != MAX_ROWS)) {
+                    continue;
+                }
+                result = board;
+                result.cells = (state *)allocate_memory((size_t)size * size);
+                memcpy(result.cells, board.cells, (size_t)size * size);
+                seconds = time_engine(engine, &result, opts->batch_gens, &memory);
+
+                if (!checked && first) {
+                    /* the first engine's result is what the others are checked against */
+                    check.cells = result.cells;
+                    outcome = "unchecked";
+                }
+                else if (memcmp(result.cells, check.cells, (size_t)size * size) == 0) {
+                    outcome = checked ? "match rules" : "match first engine";
+                }
+                else {
+                    outcome = checked ? "DIFFER FROM RULES" : "DIFFER FROM FIRST ENGINE";
+                    differ = 1;
+                }
+
+                printf("%-8s %6d %-9s %12.0f %10.4f %14.4g %12.0f ", circuits[circuit], size, 
+                    engines[engine], cells, seconds, 
+                    (seconds > 0) ? cells * opts->batch_gens / seconds : 0.0, memory / KILOBYTE);
+                if (last_cells > 0 && last_time[engine] > 0) {
+                    printf("%10.2f  %s\n", (seconds / cells) / (last_time[engine] / last_cells), outcome);
+                }
+                else {
+                    printf("%10s  %s\n", "-", outcome);
+                }
+                fflush(stdout);
+                last_time[engine] = seconds;
+                if (check.cells != result.cells) {
+                    free(result.cells);
+                }
+                first = 0;
+            }
+            /* the dense engine has no time at other sizes to compare with */
+            last_time[ENGINE_DENSE] = 0;
+            last_cells = cells;
+
+            if (check.cells != board.cells) {
+                free(check.cells);
+            }
+            free(board.cells);
+        }
+        if (strcmp(opts->filename, "all") != 0) {
+            break;
+        }
+    }
+
+    if (differ) {
+        fprintf(stderr, "Error: An engine's final cells differ\n");
+        exit(EXIT_FAILURE);
+    }
+
+} /* end run_benchmark */
+
+/* Makes a size by size circuit by repeating a tile across it, cut 
+off at the right and bottom edges, or scattering conductors and 
+heads at random (the same ones every time) */
+static int make_circuit(int circuit, int size, Board *b)
+{
+
+    /* clock loops of period 10 */
+    static const char *clock[] = {
+        "  tHcc  ", 
+        " c    c ", 
+        "  cccc  ", 
+        "        "};
+    /* a pulse on a wire through a diode each way */
+    static const char *diode[] = {
+        "    cc          ", 
+        "ccccc ccccctHccc", 
+        "    cc          ", 
+        "                ", 
+        "          cc    ", 
+        "ccctHccccc ccccc", 
+        "          cc    ", 
+        "                "};
+    /* a pulse every 8 cells along long wires */
+    static const char *wire[] = {
+        "tHcccccc", 
+        "        "};
+    /* an XOR gate fed by two clocks 3 generations apart */
+    static const char *gates[] = {
+        " tH                 ", 
+        "c  ccccccccc        ", 
+        "            c       ", 
+        "           cccc     ", 
+        "           c  cccccc", 
+        "           cccc     ", 
+        " Ht         c       ", 
+        "c  ccccccccc        ", 
+        " cc                 ", 
+        "                    "};
+    const char **tile;
+    int tile_rows, tile_cols, row, col;
+    unsigned long long r;
+
+    b->rows = b->cols = size;
+    b->gen = 0;
+    if ((b->cells = (state *)malloc((size_t)size * size)) == NULL) {
+        return WW_ERROR_MEMORY;
+    }
+
+    if (circuit == CIRCUIT_RANDOM) {
+        for (row = 0; row < size; row++) {
+            for (col = 0; col < size; col++) {
+                r = cell_key(row * size + col, CIRCUIT_RANDOM) % PERCENT;
+                b->cells[(size_t)row * size + col] = (r < RANDOM_HEADS) ? ELECTRON_HEAD : 
+                    (r < RANDOM_CONDUCTORS) ? CONDUCTOR : EMPTY;
+            }
+        }
+        return WW_OK;
+    }
+
+    if (circuit == CIRCUIT_CLOCK) {
+        tile = clock;
+        tile_rows = sizeof(clock) / sizeof(clock[0]);
+    }
+    else if (circuit == CIRCUIT_DIODE) {
+        tile = diode;
+        tile_rows = sizeof(diode) / sizeof(diode[0]);
+    }
+    else if (circuit == CIRCUIT_WIRE) {
+        tile = wire;
+        tile_rows = sizeof(wire) / sizeof(wire[0]);
+    }
+    else {
+        tile = gates;
+        tile_rows = sizeof(gates) / sizeof(gates[0]);
+    }
+    tile_cols = (int)strlen(tile[0]);
+    for (row = 0; row < size; row++) {
+        for (col = 0; col < size; col++) {
+            b->cells[(size_t)row * size + col] = tile[row % tile_rows][col % tile_cols];
+        }
+    }
+
+    return WW_OK;
+
+} /* end make_circuit */
+
+/* Runs gens generations of b with one engine, leaving the last one 
+in b. Only the stepping is timed, not setting the engine up. memory 
+is what the engine's own structures take */
+static double time_engine(int engine, Board *b, generation gens, size_t *memory)
+{
+
+    Graph g;
+    HashLife h;
+    Plane p;
+    DelayGraph d;
+    state new_arr[MAX_ROWS][MAX_COLS];
+    double start, seconds;
+    generation i;
+
+    if (engine == ENGINE_GRAPH) {
+        exit_on_error(compile_graph(&g, b->cells, b->rows, b->cols, &rules[RULE_WIREWORLD]), NULL);
+        start = seconds_now();
+        for (i = 0; i < gens; i++) {
+            step_graph(&g);
+        }
+        seconds = seconds_now() - start;
+        *memory = graph_memory(&g);
+        graph_to_array(&g, b->cells);
+        free_graph(&g);
+    }
+    else if (engine == ENGINE_HASHLIFE) {
+        hl_init(&h, b->cells, b->rows, b->cols);
+        start = seconds_now();
+        hl_advance(&h, gens);
+        seconds = seconds_now() - start;
+        *memory = (size_t)h.capacity * (sizeof(HashNode) + sizeof(int));
+        hl_write_board(&h, b->cells);
+        hl_free(&h);
+    }
+    else if (engine == ENGINE_DENSE) {
+        start = seconds_now();
+        for (i = 0; i < gens; i++) {
+            add_rules((state (*)[MAX_COLS])b->cells, new_arr);
+            copy_array(new_arr, (state (*)[MAX_COLS])b->cells);
+        }
+        seconds = seconds_now() - start;
+        *memory = 2 * sizeof(new_arr);
+    }
+    else if (engine == ENGINE_DELAY) {
+        exit_on_error(compile_graph(&g, b->cells, b->rows, b->cols, &rules[RULE_WIREWORLD]), NULL);
+        delay_init(&d, &g);
+        start = seconds_now();
+        for (i = 0; i < gens; i++) {
+            delay_step(&d);
+        }
+        seconds = seconds_now() - start;
+        *memory = delay_memory(&d);
+        delay_to_array(&d, b->cells);
+        delay_free(&d);
+        free_graph(&g);
+    }
+    else {
+        init_plane(&p);
+        plane_from_board(&p, b);
+        start = seconds_now();
+        for (i = 0; i < gens; i++) {
+            step_plane(&p);
+        }
+        seconds = seconds_now() - start;
+        *memory = (size_t)p.num_blocks * CHUNKS_PER_BLOCK * sizeof(Chunk) + 
+            (size_t)p.num_slots * sizeof(Chunk *) + (size_t)p.num_chunks * sizeof(Chunk *);
+        plane_to_board(&p, b);
+        free_plane(&p);
+    }
+
+    return seconds;
+
+} /* end time_engine */
+
+/* The rules as apply_rules has them, cell by cell with every 
+neighbour checked against the edges, for a board of any size. It is 
+only used to check the engines' answers */
+static void reference_rules(state *cells, state *new_cells, int rows, int cols)
+{
+
+    int row, col, i, j, num_heads;
+    state c;
+
+    for (row = 0; row < rows; row++) {
+        for (col = 0; col < cols; col++) {
+            c = cells[row * cols + col];
+            if (c == ELECTRON_HEAD) {
+                c = ELECTRON_TAIL;
+            }
+            else if (c == ELECTRON_TAIL) {
+                c = CONDUCTOR;
+            }
+            else if (c == CONDUCTOR) {
+                num_heads = 0;
+                for (i = -1; i < CELL_ROW_LIMIT; i++) {
+                    for (j = -1; j < CELL_COL_LIMIT; j++) {
+                        if ((i != 0 || j != 0) && row + i >= 0 && row + i < rows && 
+                            col + j >= 0 && col + j < cols && 
+                            cells[(row + i) * cols + col + j] == ELECTRON_HEAD) {
+                            num_heads++;
+                        }
+                    }
+                }
+                if (num_heads >= HEADS_TO_FIRE_MIN && num_heads <= HEADS_TO_FIRE_MAX) {
+                    c = ELECTRON_HEAD;
+                }
+            }
+            new_cells[row * cols + col] = c;
+        }
+    }
+
+} /* end reference_rules */
+
+/* copies the plane's cells back into a board it was made from */
+static void plane_to_board(Plane *p, Board *b)
+{
+
+    int i, r, first_col, last_col;
+    long long row, col;
+    Chunk *ch;
+
+    for (i = 0; i < p->num_chunks; i++) {
+        ch = p->chunks[i];
+        col = (long long)ch->chunk_col * CHUNK_SIZE;
+        first_col = (col < 0) ? (int)-col : 0;
+        last_col = (col + CHUNK_SIZE > b->cols) ? (int)(b->cols - col) : CHUNK_SIZE;
+        for (r = 0; r < CHUNK_SIZE; r++) {
+            row = (long long)ch->chunk_row * CHUNK_SIZE + r;
+            if (row >= 0 && row < b->rows && first_col < last_col) {
+                memcpy(b->cells + row * b->cols + col + first_col, 
+                    ch->cells[ch->current] + r * CHUNK_SIZE + first_col, last_col - first_col);
+            }
+        }
+    }
+
+} /* end plane_to_board */
+
+/* bytes taken by the graph's arrays */
+static size_t graph_memory(Graph *g)
+{
+
+    return (size_t)(g->num_cells + 1) * (2 * sizeof(int) + 2 * sizeof(state)) + 
+        (size_t)(g->first_neighbour[g->num_cells] + 1) * sizeof(int);
+
+} /* end graph_memory */
+
+#ifndef WW_NO_ANIMATION
+/* Runs the simulation on its own thread as fast as it will go. This 
+thread keeps ncurses to itself, drawing the newest generation fps 
+times a second and handling key and mouse events in between */
+static void animate(Graph *g, state *board, int rows, int cols, int fps, NCURS_Simplewin *sw)
+{
+
+    TripleBuffer tb;
+    Simulation sim;
+    pthread_t thread;
+    state *shown; /* cells currently on the screen */
+
+    init_triple_buffer(&tb, board, rows, cols);
+    shown = (state *)allocate_memory((size_t)rows * cols);
+    memcpy(shown, board, (size_t)rows * cols);
+
+    sim.g = g;
+    sim.tb = &tb;
+    sim.running = RUNNING;
+    if (pthread_create(&thread, NULL, simulate, &sim) != 0) {
+        fprintf(stderr, "Error: Cannot start simulation thread\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* continues looping until mouse click or ESC key pressed */
+    do {
+        if (take_frame(&tb)) {
+            draw_changes(shown, tb.frames[tb.front], rows, cols, tb.gens[tb.front]);
+        }
+        Neill_NCURS_Delay(MILLISECONDS / fps);
+        Neill_NCURS_Events(sw); /* Wait for mouse click, or ESC key event */
+    } while (!sw->finished); 
+
+    __atomic_store_n(&sim.running, STOPPED, __ATOMIC_RELEASE);
+    pthread_join(thread, NULL);
+
+    free(shown);
+    free_triple_buffer(&tb);
+
+} /* end animate */
+
+/* every frame starts as a copy of the board, so the empty cells 
+(which never change) are already in place */
+static void init_triple_buffer(TripleBuffer *tb, state *board, int rows, int cols)
+{
+
+    int i;
+
+    for (i = 0; i < NUM_FRAMES; i++) {
+        tb->frames[i] = (state *)allocate_memory((size_t)rows * cols);
+        memcpy(tb->frames[i], board, (size_t)rows * cols);
+        tb->gens[i] = 0;
+    }
+    tb->back = 0;
+    tb->middle = 1;
+    tb->front = 2;
+
+} /* end init_triple_buffer */
+
+static void free_triple_buffer(TripleBuffer *tb)
+{
+
+    int i;
+
+    for (i = 0; i < NUM_FRAMES; i++) {
+        free(tb->frames[i]);
+    }
+
+} /* end free_triple_buffer */
+
+/* called by the writer once its back frame is complete */
+static void publish_frame(TripleBuffer *tb)
+{
+
+    tb->back = __atomic_exchange_n(&tb->middle, tb->back | FRAME_FRESH, 
+        __ATOMIC_ACQ_REL) & FRAME_INDEX;
+
+} /* end publish_frame */
+
+/* called by the reader - returns 1 if the front frame is now a newer 
+generation than it was */
+static int take_frame(TripleBuffer *tb)
+{
+
+    if ((__atomic_load_n(&tb->middle, __ATOMIC_ACQUIRE) & FRAME_FRESH) == 0) {
+        return 0;
+    }
+    tb->front = __atomic_exchange_n(&tb->middle, tb->front, __ATOMIC_ACQ_REL) & FRAME_INDEX;
+
+    return 1;
+
+} /* end take_frame */
+
+/* simulation thread - steps the graph and publishes every generation */
+static void *simulate(void *arg)
+{
+
+    Simulation *sim = (Simulation *)arg;
+    TripleBuffer *tb = sim->tb;
+    generation gen = 0;
+
+    while (__atomic_load_n(&sim->running, __ATOMIC_ACQUIRE) == RUNNING) {
+        step_graph(sim->g);
+        graph_to_array(sim->g, tb->frames[tb->back]);
+        tb->gens[tb->back] = ++gen;
+        publish_frame(tb);
+    }
+
+    return NULL;
+
+} /* end simulate */
+
+/* Colour pairs for drawing single cells, the same colours as 
+set_colors. They are fixed numbers above the few pairs neillncurses 
+uses, and below 256 so COLOR_PAIR can hold them */
+static void init_dirty_colors(void)
+{
+
+    init_pair(TAIL_PAIR, COLOR_RED, COLOR_RED);
+    init_pair(CONDUCTOR_PAIR, COLOR_YELLOW, COLOR_YELLOW);
+    init_pair(HEAD_PAIR, COLOR_BLUE, COLOR_BLUE);
+    init_pair(EMPTY_PAIR, COLOR_BLACK, COLOR_BLACK);
+
+} /* end init_dirty_colors */
+
+/* redraws only the cells of frame which differ from what is shown, 
+and the generation number underneath the board */
+static void draw_changes(state *shown, state *frame, int rows, int cols, generation gen)
+{
+
+    int cell, pair;
+
+    for (cell = 0; cell < rows * cols; cell++) {
+        if (shown[cell] == frame[cell]) {
+            continue;
+        }
+        if (frame[cell] == ELECTRON_TAIL) {
+            pair = TAIL_PAIR;
+        }
+        else if (frame[cell] == CONDUCTOR) {
+            pair = CONDUCTOR_PAIR;
+        }
+        else if (frame[cell] == ELECTRON_HEAD) {
+            pair = HEAD_PAIR;
+        }
+        else {
+            pair = EMPTY_PAIR;
+        }
+        mvaddch(cell / cols, cell % cols, (chtype)frame[cell] | COLOR_PAIR(pair));
+        shown[cell] = frame[cell];
+    }
+    mvprintw(rows, 0, "Generation %llu", gen);
+    refresh();
+
+} /* end draw_changes */
+#endif
+
+/* Runs opts->batch_gens generations of every copy of the circuit in 
+the sweep file, then prints each copy's final board in the order 
+they appear in the file, separated by blank lines */
+static void run_sweep(Options *opts, state *board, int rows, int cols, Graph *g)
+{
+
+    SlicedGraph sg;
+    generation gen;
+    double start, sim_time;
+    int instance, i;
+
+    init_sliced_graph(&sg, g);
+    read_sweep_file(opts->sweep_file, &sg, cols);
+
+    start = seconds_now();
+    for (gen = 0; gen < opts->batch_gens; gen++) {
+        step_sliced(&sg);
+    }
+    sim_time = seconds_now() - start;
+
+    setvbuf(stdout, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+    for (instance = 0; instance < sg.num_instances; instance++) {
+        for (i = 0; i < g->num_cells; i++) {
+            board[g->position[i]] = instance_cell(&sg, instance, i);
+        }
+        if (instance > 0) {
+            putchar('\n');
+        }
+        write_board(stdout, board, rows, cols);
+    }
+    fflush(stdout);
+
+    fprintf(stderr, "%d circuits, %llu generations in %.3f s\n", 
+        sg.num_instances, opts->batch_gens, sim_time);
+    if (sim_time > 0) {
+        fprintf(stderr, "%.4g cell updates/sec\n", (double)rows * cols * 
+            sg.num_instances * opts->batch_gens / sim_time);
+    }
+
+    free_sliced_graph(&sg);
+
+} /* end run_sweep */
+
+static void init_sliced_graph(SlicedGraph *sg, Graph *g)
+{
+
+    size_t size = sizeof(lane) * LANE_WORDS * (g->num_cells + 1);
+
+    sg->g = g;
+    sg->num_instances = 0;
+    sg->heads = (lane *)allocate_memory(size);
+    sg->tails = (lane *)allocate_memory(size);
+    sg->new_heads = (lane *)allocate_memory(size);
+    sg->new_tails = (lane *)allocate_memory(size);
+    memset(sg->heads, 0, size);
+    memset(sg->tails, 0, size);
+
+} /* end init_sliced_graph */
+
+/* Each line of the sweep file is one copy of the circuit as it was 
+read, with the cells listed on the line changed - for example 
+"3,5 10,2,t" makes (row 3, col 5) an electron head and (row 10, 
+col 2) an electron tail. A blank line is the circuit unchanged */
+static void read_sweep_file(char *filename, SlicedGraph *sg, int cols)
+{
+
+    FILE *fp;
+    char line[MAX_LINE], *token, c;
+    int i, row, col, fields;
+
+    if ((fp = fopen(filename, "r")) == NULL) {
+        fprintf(stderr, "Error: Cannot open file\n");
+        exit(EXIT_FAILURE);
+    }
+
+    while (fgets(line, MAX_LINE, fp) != NULL) {
+        if (sg->num_instances == NUM_LANES) {
+            fprintf(stderr, "Error: Sweep file has more than %d circuits\n", NUM_LANES);
+            exit(EXIT_FAILURE);
+        }
+        for (i = 0; i < sg->g->num_cells; i++) {
+            set_instance_cell(sg, sg->num_instances, i, sg->g->cells[i]);
+        }
+        for (token = strtok(line, " \t\r\n"); token != NULL; token = strtok(NULL, " \t\r\n")) {
+            c = ELECTRON_HEAD;
+            fields = sscanf(token, "%d,%d,%c", &row, &col, &c);
+            if (fields < 2 || col < 0 || col >= cols || row < 0 || 
+                (i = find_conductor(sg->g, row * cols + col)) == NOT_A_CONDUCTOR || 
+                !is_conductor(c)) {
+                fprintf(stderr, "Error: Invalid signal \"%s\" in sweep file\n", token);
+                exit(EXIT_FAILURE);
+            }
+            set_instance_cell(sg, sg->num_instances, i, c);
+        }
+        sg->num_instances++;
+    }
+
+    fclose(fp);
+
+} /* end read_sweep_file */
+
+static void set_instance_cell(SlicedGraph *sg, int instance, int i, state c)
+{
+
+    lane bit = 1ULL << (instance % LANE_BITS);
+    int word = i * LANE_WORDS + instance / LANE_BITS;
+
+    sg->heads[word] &= ~bit;
+    sg->tails[word] &= ~bit;
+    if (c == ELECTRON_HEAD) {
+        sg->heads[word] |= bit;
+    }
+    else if (c == ELECTRON_TAIL) {
+        sg->tails[word] |= bit;
+    }
+
+} /* end set_instance_cell */
+
+static state instance_cell(SlicedGraph *sg, int instance, int i)
+{
+
+    lane bit = 1ULL << (instance % LANE_BITS);
+    int word = i * LANE_WORDS + instance / LANE_BITS;
+
+    if (sg->heads[word] & bit) {
+        return ELECTRON_HEAD;
+    }
+    else if (sg->tails[word] & bit) {
+        return ELECTRON_TAIL;
+    }
+    else {
+        return CONDUCTOR;
+    }
+
+} /* end instance_cell */
+
+#endif
+
+/* binary search for the conductor at a board position - conductors 
+are numbered in row order, so their positions are sorted */
+static int find_conductor(Graph *g, int position)
+{
+
+    int low, high, middle;
+
+    low = 0;
+    high = g->num_cells - 1;
+    while (low <= high) {
+        middle = (low + high) / 2;
+        if (g->position[middle] == position) {
+            return middle;
+        }
+        else if (g->position[middle] < position) {
+            low = middle + 1;
+        }
+        else {
+            high = middle - 1;
+        }
+    }
+
+    return NOT_A_CONDUCTOR;
+
+} /* end find_conductor */
+
+#ifndef WW_LIBRARY
+/* Steps every copy at once. The heads next to each cell are added up 
+bit by bit - ones, twos and fours are the bits of the count in each 
+copy, with fours sticking once set. A conductor fires when the count 
+is 1 or 2, which is when exactly one of ones and twos is set */
+static void step_sliced(SlicedGraph *sg)
+{
+
+    Graph *g = sg->g;
+    lane ones[LANE_WORDS], twos[LANE_WORDS], fours[LANE_WORDS];
+    lane carry, head, *temp;
+    int i, k, w, n;
+
+    for (i = 0; i < g->num_cells; i++) {
+        for (w = 0; w < LANE_WORDS; w++) {
+            ones[w] = twos[w] = fours[w] = 0;
+        }
+        for (k = g->first_neighbour[i]; k < g->first_neighbour[i + 1]; k++) {
+            n = g->neighbours[k] * LANE_WORDS;
+            for (w = 0; w < LANE_WORDS; w++) {
+                head = sg->heads[n + w];
+                carry = ones[w] & head;
+                ones[w] ^= head;
+                fours[w] |= twos[w] & carry;
+                twos[w] ^= carry;
+            }
+        }
+        for (w = 0; w < LANE_WORDS; w++) {
+            n = i * LANE_WORDS + w;
+            /* heads become tails, tails become conductors */
+            sg->new_tails[n] = sg->heads[n];
+            sg->new_heads[n] = (ones[w] ^ twos[w]) & ~fours[w] & 
+                ~(sg->heads[n] | sg->tails[n]);
+        }
+    }
+
+    temp = sg->heads; sg->heads = sg->new_heads; sg->new_heads = temp;
+    temp = sg->tails; sg->tails = sg->new_tails; sg->new_tails = temp;
+
+} /* end step_sliced */
+
+static void free_sliced_graph(SlicedGraph *sg)
+{
+
+    free(sg->heads);
+    free(sg->tails);
+    free(sg->new_heads);
+    free(sg->new_tails);
+
+} /* end free_sliced_graph */
+
+static void init_plane(Plane *p)
+{
+
+    int i;
+
+    p->num_slots = INITIAL_CHUNK_SLOTS;
+    p->slots = (Chunk **)allocate_memory(sizeof(Chunk *) * p->num_slots);
+    for (i = 0; i < p->num_slots; i++) {
+        p->slots[i] = NULL;
+    }
+    p->chunks = (Chunk **)allocate_memory(sizeof(Chunk *) * p->num_slots);
+    p->num_chunks = 0;
+    p->blocks = (Chunk **)allocate_memory(sizeof(Chunk *) * p->num_slots);
+    p->num_blocks = 0;
+    /* an empty rectangle until a cell is set */
+    p->min_row = p->min_col = 0;
+    p->max_row = p->max_col = -1;
+    p->rows = p->cols = 0;
+
+} /* end init_plane */
+
+static void free_plane(Plane *p)
+{
+
+    int i;
+
+    for (i = 0; i < p->num_blocks; i++) {
+        free(p->blocks[i]);
+    }
+    free(p->blocks);
+    free(p->chunks);
+    free(p->slots);
+
+} /* end free_plane */
+
+/* Reads a text file of any size into the plane the way 
+read_text_board reads it into a board - mapped, checked in blocks 
+and a line at a time - so both reject the same files, with the line 
+and column of the bad character left in b. Only the non-empty cells 
+are set, so stretches of empty space cost nothing, but the plane 
+keeps the size of the file so it is written out the same size */
+static int read_text_plane(char *filename, Plane *p, Board *b)
+{
+
+    char *data;
+    const char *line, *end, *newline;
+    size_t size, offset, col;
+    long long row;
+    int mapped, error;
+
+    if ((error = map_text_file(filename, &data, &size, &mapped)) != WW_OK) {
+        return error;
+    }
+    if ((offset = find_invalid(data, size)) < size) {
+        locate_invalid(data, offset, b);
+        error = WW_ERROR_CHARACTER;
+    }
+
+    end = (error == WW_OK) ? data + size : data;
+    p->rows = p->cols = 1;
+    for (row = 0, line = data; line < end; row++, line = newline + 1) {
+        if ((newline = (const char *)memchr(line, '\n', end - line)) == NULL) {
+            newline = end;
+        }
+        for (col = 0; line + col < newline; col++) {
+            if (line[col] != EMPTY) {
+                set_plane_cell(p, row, (long long)col, line[col]);
+            }
+        }
+        p->cols = ((long long)col > p->cols) ? (long long)col : p->cols;
+    }
+    p->rows = (row > p->rows) ? row : p->rows;
+
+    if (mapped) {
+        munmap(data, size);
+    }
+    else {
+        free(data);
+    }
+
+    return error;
+
+} /* end read_text_plane */
+
+/* division which rounds down, so cells at negative positions are in 
+the chunk to their left */
+static long long floor_divide(long long a, long long b)
+{
+
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+
+} /* end floor_divide */
+
+static unsigned int chunk_hash(int chunk_row, int chunk_col)
+{
+
+    unsigned int x;
+
+    x = (unsigned int)chunk_row * 0x9E3779B1u ^ (unsigned int)chunk_col * 0x85EBCA77u;
+
+    return x ^ (x >> 16);
+
+} /* end chunk_hash */
+
+/* returns the chunk at a chunk position, or NULL if there is none */
+static Chunk *find_chunk(Plane *p, int chunk_row, int chunk_col)
+{
+
+    unsigned int slot;
+    Chunk *ch;
+
+    slot = chunk_hash(chunk_row, chunk_col) & (p->num_slots - 1);
+    while ((ch = p->slots[slot]) != NULL) {
+        if (ch->chunk_row == chunk_row && ch->chunk_col == chunk_col) {
+            return ch;
+        }
+        slot = (slot + 1) & (p->num_slots - 1);
+    }
+
+    return NULL;
+
+} /* end find_chunk */
+
+/* Makes a new empty chunk, taken from the current block of chunks, 
+and links it to the chunks around it */
+static Chunk *add_chunk(Plane *p, int chunk_row, int chunk_col)
+{
+
+    Chunk *ch, *other;
+    unsigned int slot;
+    int i, d, cell;
+    static const int row_offset[NUM_NEIGHBOURS] = {-1, -1, -1, 0, 0, 1, 1, 1};
+    static const int col_offset[NUM_NEIGHBOURS] = {-1, 0, 1, -1, 1, -1, 0, 1};
+
+    /* keep the table at most half full, and the chunk and block lists 
+    the same size as it */
+    if (2 * (p->num_chunks + 1) > p->num_slots) {
+        free(p->slots);
+        p->num_slots *= 2;
+        p->slots = (Chunk **)allocate_memory(sizeof(Chunk *) * p->num_slots);
+        for (i = 0; i < p->num_slots; i++) {
+            p->slots[i] = NULL;
+        }
+        for (i = 0; i < p->num_chunks; i++) {
+            slot = chunk_hash(p->chunks[i]->chunk_row, p->chunks[i]->chunk_col) & (p->num_slots - 1);
+            while (p->slots[slot] != NULL) {
+                slot = (slot + 1) & (p->num_slots - 1);
+            }
+            p->slots[slot] = p->chunks[i];
+        }
+        p->chunks = (Chunk **)realloc(p->chunks, sizeof(Chunk *) * p->num_slots);
+        p->blocks = (Chunk **)realloc(p->blocks, sizeof(Chunk *) * p->num_slots);
+        if (p->chunks == NULL || p->blocks == NULL) {
+            fprintf(stderr, "Error: Cannot allocate space. Not enough memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (p->num_chunks % CHUNKS_PER_BLOCK == 0) {
+        p->blocks[p->num_blocks++] = (Chunk *)allocate_memory(sizeof(Chunk) * CHUNKS_PER_BLOCK);
+    }
+    ch = &p->blocks[p->num_blocks - 1][p->num_chunks % CHUNKS_PER_BLOCK];
+    p->chunks[p->num_chunks++] = ch;
+
+    ch->chunk_row = chunk_row;
+    ch->chunk_col = chunk_col;
+    for (cell = 0; cell < CHUNK_CELLS; cell++) {
+        ch->cells[0][cell] = ch->cells[1][cell] = EMPTY;
+    }
+    ch->current = 0;
+    ch->population = ch->heads = ch->tails = 0;
+    ch->stepped = 0;
+
+    /* neighbour d of this chunk has this chunk as its neighbour 
+    NUM_NEIGHBOURS - 1 - d, as the offsets are in mirrored order */
+    for (d = 0; d < NUM_NEIGHBOURS; d++) {
+        other = find_chunk(p, chunk_row + row_offset[d], chunk_col + col_offset[d]);
+        ch->neighbours[d] = other;
+        if (other != NULL) {
+            other->neighbours[NUM_NEIGHBOURS - 1 - d] = ch;
+        }
+    }
+
+    slot = chunk_hash(chunk_row, chunk_col) & (p->num_slots - 1);
+    while (p->slots[slot] != NULL) {
+        slot = (slot + 1) & (p->num_slots - 1);
+    }
+    p->slots[slot] = ch;
+
+    return ch;
+
+} /* end add_chunk */
+
+/* sets a cell of the plane, making its chunk if need be */
+static void set_plane_cell(Plane *p, long long row, long long col, state c)
+{
+
+    Chunk *ch;
+    int chunk_row, chunk_col, cell;
+    state old;
+
+    chunk_row = (int)floor_divide(row, CHUNK_SIZE);
+    chunk_col = (int)floor_divide(col, CHUNK_SIZE);
+    if ((ch = find_chunk(p, chunk_row, chunk_col)) == NULL) {
+        if (c == EMPTY) {
+            return;
+        }
+        ch = add_chunk(p, chunk_row, chunk_col);
+    }
+
+    cell = (int)(row - (long long)chunk_row * CHUNK_SIZE) * CHUNK_SIZE + 
+        (int)(col - (long long)chunk_col * CHUNK_SIZE);
+    old = ch->cells[ch->current][cell];
+    ch->population += (c != EMPTY) - (old != EMPTY);
+    ch->heads += (c == ELECTRON_HEAD) - (old == ELECTRON_HEAD);
+    ch->tails += (c == ELECTRON_TAIL) - (old == ELECTRON_TAIL);
+    ch->cells[ch->current][cell] = c;
+
+    if (c != EMPTY) {
+        if (p->max_row < p->min_row) {
+            p->min_row = p->max_row = row;
+            p->min_col = p->max_col = col;
+        }
+        p->min_row = (row < p->min_row) ? row : p->min_row;
+        p->max_row = (row > p->max_row) ? row : p->max_row;
+        p->min_col = (col < p->min_col) ? col : p->min_col;
+        p->max_col = (col > p->max_col) ? col : p->max_col;
+    }
+
+} /* end set_plane_cell */
+
+static state plane_cell(Plane *p, long long row, long long col)
+{
+
+    Chunk *ch;
+    int chunk_row, chunk_col;
+
+    chunk_row = (int)floor_divide(row, CHUNK_SIZE);
+    chunk_col = (int)floor_divide(col, CHUNK_SIZE);
+    if ((ch = find_chunk(p, chunk_row, chunk_col)) == NULL) {
+        return EMPTY;
+    }
+
+    return ch->cells[ch->current][(int)(row - (long long)chunk_row * CHUNK_SIZE) * CHUNK_SIZE + 
+        (int)(col - (long long)chunk_col * CHUNK_SIZE)];
+
+} /* end plane_cell */
+
+/* A chunk with no signals in it, and none next to it, stays exactly 
+as it is - its conductors have no heads to fire them */
+static int needs_step(Chunk *ch)
+{
+
+    int d;
+
+    if (ch->population == 0) {
+        return 0;
+    }
+    if (ch->heads > 0 || ch->tails > 0) {
+        return 1;
+    }
+    for (d = 0; d < NUM_NEIGHBOURS; d++) {
+        if (ch->neighbours[d] != NULL && ch->neighbours[d]->heads > 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+
+} /* end needs_step */
+
+/* Works out the chunk's next generation. The chunk and a one cell 
+border taken from its neighbours are copied into a halo first, so 
+every cell is stepped the same way with no edge checks */
+static void step_chunk(Chunk *ch)
+{
+
+    state halo[HALO_SIZE][HALO_SIZE];
+    state *cells, *next, c;
+    Chunk *other;
+    int row, col, i, j, num_heads, heads, tails;
+
+    cells = ch->cells[ch->current];
+    next = ch->cells[!ch->current];
+
+    memset(halo, EMPTY, sizeof(halo));
+    for (row = 0; row < CHUNK_SIZE; row++) {
+        memcpy(&halo[row + 1][1], cells + row * CHUNK_SIZE, CHUNK_SIZE);
+    }
+    /* neighbours are NW, N, NE, W, E, SW, S, SE */
+    if ((other = ch->neighbours[0]) != NULL) {
+        halo[0][0] = other->cells[other->current][CHUNK_CELLS - 1];
+    }
+    if ((other = ch->neighbours[1]) != NULL) {
+        memcpy(&halo[0][1], other->cells[other->current] + CHUNK_CELLS - CHUNK_SIZE, CHUNK_SIZE);
+    }
+    if ((other = ch->neighbours[2]) != NULL) {
+        halo[0][HALO_SIZE - 1] = other->cells[other->current][CHUNK_CELLS - CHUNK_SIZE];
+    }
+    for (row = 0; row < CHUNK_SIZE; row++) {
+        if ((other = ch->neighbours[3]) != NULL) {
+            halo[row + 1][0] = other->cells[other->current][row * CHUNK_SIZE + CHUNK_SIZE - 1];
+        }
+        if ((other = ch->neighbours[4]) != NULL) {
+            halo[row + 1][HALO_SIZE - 1] = other->cells[other->current][row * CHUNK_SIZE];
+        }
+    }
+    if ((other = ch->neighbours[5]) != NULL) {
+        halo[HALO_SIZE - 1][0] = other->cells[other->current][CHUNK_SIZE - 1];
+    }
+    if ((other = ch->neighbours[6]) != NULL) {
+        memcpy(&halo[HALO_SIZE - 1][1], other->cells[other->current], CHUNK_SIZE);
+    }
+    if ((other = ch->neighbours[7]) != NULL) {
+        halo[HALO_SIZE - 1][HALO_SIZE - 1] = other->cells[other->current][0];
+    }
+
+    heads = tails = 0;
+    for (row = 1; row <= CHUNK_SIZE; row++) {
+        for (col = 1; col <= CHUNK_SIZE; col++) {
+            c = halo[row][col];
+            if (c == ELECTRON_HEAD) {
+                c = ELECTRON_TAIL;
+                tails++;
+            }
+            else if (c == ELECTRON_TAIL) {
+                c = CONDUCTOR;
+            }
+            else if (c == CONDUCTOR) {
+                num_heads = 0;
+                for (i = -1; i < CELL_ROW_LIMIT; i++) {
+                    for (j = -1; j < CELL_COL_LIMIT; j++) {
+                        num_heads += (halo[row + i][col + j] == ELECTRON_HEAD);
+                    }
+                }
+                if (num_heads >= HEADS_TO_FIRE_MIN && num_heads <= HEADS_TO_FIRE_MAX) {
+                    c = ELECTRON_HEAD;
+                    heads++;
+                }
+            }
+            next[(row - 1) * CHUNK_SIZE + col - 1] = c;
+        }
+    }
+
+    /* other chunks still need this generation's counts, so the new 
+    ones are kept aside until every chunk has been stepped */
+    ch->stepped = 1;
+    ch->new_heads = heads;
+    ch->new_tails = tails;
+
+} /* end step_chunk */
+
+/* Steps every chunk that could change. All the new generations are 
+worked out before any chunk flips to its new one, as chunks read 
+their neighbours' current generation */
+static void step_plane(Plane *p)
+{
+
+    int i;
+    Chunk *ch;
+
+    for (i = 0; i < p->num_chunks; i++) {
+        if (needs_step(p->chunks[i])) {
+            step_chunk(p->chunks[i]);
+        }
+    }
+    for (i = 0; i < p->num_chunks; i++) {
+        ch = p->chunks[i];
+        if (ch->stepped) {
+            ch->current = !ch->current;
+            ch->heads = ch->new_heads;
+            ch->tails = ch->new_tails;
+            ch->stepped = 0;
+        }
+    }
+
+} /* end step_plane */
+
+/* writes the plane from row 0, col 0 (or its top left cell, if that 
+is further up or left) to its bottom right cell, or the bottom right 
+of the file it was read from if that is further down or right */
+static void write_plane(FILE *fp, Plane *p)
+{
+
+    long long row, col, top, left, bottom, right, end;
+    int cols, chunk_row, chunk_col;
+    state *line;
+    Chunk *ch;
+
+    top = (p->min_row < 0) ? p->min_row : 0;
+    left = (p->min_col < 0) ? p->min_col : 0;
+    bottom = (p->max_row > p->rows - 1) ? p->max_row : p->rows - 1;
+    right = (p->max_col > p->cols - 1) ? p->max_col : p->cols - 1;
+    cols = (int)(right - left + 1);
+    line = (state *)allocate_memory(cols + 1);
+
+    /* each row is copied a chunk's width at a time */
+    for (row = top; row <= bottom; row++) {
+        chunk_row = (int)floor_divide(row, CHUNK_SIZE);
+        for (col = left; col <= right; col = end) {
+            chunk_col = (int)floor_divide(col, CHUNK_SIZE);
+            end = ((long long)chunk_col + 1) * CHUNK_SIZE;
+            end = (end > right + 1) ? right + 1 : end;
+            if ((ch = find_chunk(p, chunk_row, chunk_col)) == NULL) {
+                memset(line + (col - left), EMPTY, end - col);
+            }
+            else {
+                memcpy(line + (col - left), ch->cells[ch->current] + 
+                    (row - (long long)chunk_row * CHUNK_SIZE) * CHUNK_SIZE + 
+                    (col - (long long)chunk_col * CHUNK_SIZE), end - col);
+            }
+        }
+        write_board(fp, line, 1, cols);
+    }
+
+    free(line);
+
+} /* end write_plane */
+
+static void plane_from_board(Plane *p, Board *b)
+{
+
+    int row, col;
+
+    for (row = 0; row < b->rows; row++) {
+        for (col = 0; col < b->cols; col++) {
+            if (b->cells[row * b->cols + col] != EMPTY) {
+                set_plane_cell(p, row, col, b->cells[row * b->cols + col]);
+            }
+        }
+    }
+    p->rows = b->rows;
+    p->cols = b->cols;
+
+} /* end plane_from_board */
+
+#endif
+
+/* Works out what kind of file a circuit is in from its first bytes. 
+Packed files start with PACKED_MAGIC, and RLE files with a comment 
+or their "x = " header, neither of which can start a text circuit */
+static int file_format(const char *filename, int *format)
+{
+
+    FILE *fp;
+    char start[PACKED_MAGIC_LENGTH];
+    size_t n;
+
+    if ((fp = fopen(filename, "rb")) == NULL) {
+        return WW_ERROR_OPEN;
+    }
+    n = fread(start, 1, PACKED_MAGIC_LENGTH, fp);
+    fclose(fp);
+
+    if (n == PACKED_MAGIC_LENGTH && memcmp(start, PACKED_MAGIC, PACKED_MAGIC_LENGTH) == 0) {
+        *format = FORMAT_PACKED;
+    }
+    else if (n > 0 && (start[0] == '#' || start[0] == 'x')) {
+        *format = FORMAT_RLE;
+    }
+    else {
+        *format = FORMAT_TEXT;
+    }
+
+    return WW_OK;
+
+} /* end file_format */
+
+/* Reads a board from a text, RLE or packed file. Nothing here exits, 
+so the library can use it - the errors are returned instead, and 
+b->cells is only allocated if it worked */
+static int load_board(const char *filename, Board *b)
+{
+
+    FILE *fp;
+    int format, error;
+
+    b->gen = 0;
+    b->error_line = b->error_column = 0;
+    if ((error = file_format(filename, &format)) != WW_OK) {
+        return error;
+    }
+    if (format == FORMAT_PACKED) {
+        return load_packed(filename, b);
+    }
+    if (format == FORMAT_TEXT) {
+        return read_text_board(filename, b);
+    }
+
+    if ((fp = fopen(filename, "r")) == NULL) {
+        return WW_ERROR_OPEN;
+    }
+    error = read_rle(fp, b);
+    fclose(fp);
+
+    return error;
+
+} /* end load_board */
+
+#ifndef WW_LIBRARY
+/* the command line's way of handling an error - say what it was and 
+stop. b gives the position of an invalid character, if there is one */
+static void exit_on_error(int error, Board *b)
+{
+
+    if (error == WW_OK) {
+        return;
+    }
+    if (error == WW_ERROR_CHARACTER && b != NULL && b->error_line > 0) {
+        fprintf(stderr, "Error: %s at line %lu, column %lu\n", 
+            ww_error_message(error), b->error_line, b->error_column);
+    }
+    else {
+        fprintf(stderr, "Error: %s\n", ww_error_message(error));
+    }
+    exit(EXIT_FAILURE);
+
+} /* end exit_on_error */
+
+/* makes the board rows by cols, with the new cells on the right and 
+at the bottom empty */
+static void pad_board(Board *b, int rows, int cols)
+{
+
+    state *cells;
+    int row;
+
+    cells = (state *)allocate_memory((size_t)rows * cols);
+    memset(cells, EMPTY, (size_t)rows * cols);
+    for (row = 0; row < b->rows; row++) {
+        memcpy(cells + (size_t)row * cols, b->cells + (size_t)row * b->cols, b->cols);
+    }
+    free(b->cells);
+    b->cells = cells;
+    b->rows = rows;
+    b->cols = cols;
+
+} /* end pad_board */
+#endif
+
+/* Reads a text circuit in one go - the whole file is mapped (or read 
+in large blocks when it can't be), checked 16 bytes at a time, and 
+each line copied into its row with memcpy. The board is as wide as 
+the longest line and as tall as the file, so short lines are padded 
+with empty cells */
+static int read_text_board(const char *filename, Board *b)
+{
+
+    char *data;
+    const char *line, *end, *newline;
+    size_t size, length, offset;
+    int mapped, row, error;
+
+    if ((error = map_text_file(filename, &data, &size, &mapped)) != WW_OK) {
+        return error;
+    }
+    if ((offset = find_invalid(data, size)) < size) {
+        locate_invalid(data, offset, b);
+        error = WW_ERROR_CHARACTER;
+    }
+
+    /* first pass finds the size of the board, which is at least 1 by 1 
+    so an empty file is an empty board */
+    b->rows = b->cols = 1;
+    end = (error == WW_OK) ? data + size : data;
+    for (row = 0, line = data; line < end; row++, line = newline + 1) {
+        if ((newline = (const char *)memchr(line, '\n', end - line)) == NULL) {
+            newline = end;
+        }
+        length = newline - line;
+        if (length > (size_t)b->cols) {
+            b->cols = (int)length;
+        }
+    }
+    if (row > b->rows) {
+        b->rows = row;
+    }
+
+    /* second pass copies every line into its row */
+    if (error == WW_OK && (b->cells = (state *)malloc((size_t)b->rows * b->cols)) == NULL) {
+        error = WW_ERROR_MEMORY;
+    }
+    if (error == WW_OK) {
+        memset(b->cells, EMPTY, (size_t)b->rows * b->cols);
+        for (row = 0, line = data; line < end; row++, line = newline + 1) {
+            if ((newline = (const char *)memchr(line, '\n', end - line)) == NULL) {
+                newline = end;
+            }
+            memcpy(b->cells + (size_t)row * b->cols, line, newline - line);
+        }
+    }
+
+    if (mapped) {
+        munmap(data, size);
+    }
+    else {
+        free(data);
+    }
+
+    return error;
+
+} /* end read_text_board */
+
+/* Maps a file into memory, or reads all of it into a buffer when it 
+can't be mapped (an empty file or a pipe) */
+static int map_text_file(const char *filename, char **data, size_t *size, int *mapped)
+{
+
+    FILE *fp;
+    struct stat info;
+    char *bigger;
+    size_t capacity, n;
+
+    if ((fp = fopen(filename, "r")) == NULL) {
+        return WW_ERROR_OPEN;
+    }
+
+    if (fstat(fileno(fp), &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        *data = (char *)mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+        if (*data != MAP_FAILED) {
+            fclose(fp);
+            *size = (size_t)info.st_size;
+            *mapped = 1;
+            return WW_OK;
+        }
+    }
+
+    capacity = READ_BLOCK;
+    *size = 0;
+    *mapped = 0;
+    if ((*data = (char *)malloc(capacity)) == NULL) {
+        fclose(fp);
+        return WW_ERROR_MEMORY;
+    }
+    while ((n = fread(*data + *size, 1, capacity - *size, fp)) > 0) {
+        *size += n;
+        if (*size == capacity) {
+            capacity *= 2;
+            if ((bigger = (char *)realloc(*data, capacity)) == NULL) {
+                free(*data);
+                fclose(fp);
+                return WW_ERROR_MEMORY;
+            }
+            *data = bigger;
+        }
+    }
+    fclose(fp);
+
+    return WW_OK;
+
+} /* end map_text_file */
+
+/* Returns the offset of the first byte that isn't ' ', 't', 'H', 'c' 
+or '\n', or size if they all are. With SSE2 each block of 16 bytes 
+is compared against the five characters at once, and only a block 
+holding a bad byte is looked at one character at a time */
+static size_t find_invalid(const char *data, size_t size)
+{
+
+    size_t i;
+    char c;
+#ifdef __SSE2__
+    __m128i bytes, valid;
+    const __m128i head = _mm_set1_epi8(ELECTRON_HEAD);
+    const __m128i tail = _mm_set1_epi8(ELECTRON_TAIL);
+    const __m128i conductor = _mm_set1_epi8(CONDUCTOR);
+    const __m128i empty = _mm_set1_epi8(EMPTY);
+    const __m128i newline = _mm_set1_epi8('\n');
+#endif
+
+    i = 0;
+#ifdef __SSE2__
+    for (; i + TEXT_BLOCK <= size; i += TEXT_BLOCK) {
+        bytes = _mm_loadu_si128((const __m128i *)(data + i));
+        valid = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, head), 
+                                          _mm_cmpeq_epi8(bytes, tail)), 
+                             _mm_or_si128(_mm_cmpeq_epi8(bytes, conductor), 
+                                          _mm_or_si128(_mm_cmpeq_epi8(bytes, empty), 
+                                                       _mm_cmpeq_epi8(bytes, newline))));
+        if (_mm_movemask_epi8(valid) != ALL_BYTES_VALID) {
+            break;
+        }
+    }
+#endif
+
+    /* the rest of the file, and any block with a bad byte in it */
+    for (; i < size; i++) {
+        c = data[i];
+        if (check_characters(c) == INVALID) {
+            return i;
+        }
+    }
+    return size;
+
+} /* end find_invalid */
+
+/* works out the line and column of the invalid byte at offset */
+static void locate_invalid(const char *data, size_t offset, Board *b)
+{
+
+    const char *line, *newline;
+
+    b->error_line = 1;
+    line = data;
+    while ((newline = (const char *)memchr(line, '\n', data + offset - line)) != NULL) {
+        b->error_line++;
+        line = newline + 1;
+    }
+    b->error_column = (unsigned long)(data + offset - line) + 1;
+
+} /* end locate_invalid */
+
+/* Reads a run length encoded circuit in the format Golly uses for 
+WireWorld - '.' is empty, 'A' a head, 'B' a tail and 'C' a conductor, 
+each optionally after a repeat count. '$' ends a row and '!' the 
+pattern. A "#CXRLE ... Gen=n" comment gives the generation */
+static int read_rle(FILE *fp, Board *b)
+{
+
+    char line[MAX_LINE], *gen;
+    int c, row, col, count, cols, rows;
+    const char *code;
+    state cells[] = {EMPTY, ELECTRON_HEAD, ELECTRON_TAIL, CONDUCTOR};
+
+    rows = cols = -1;
+    while (rows < 0 && fgets(line, MAX_LINE, fp) != NULL) {
+        if (line[0] == '#') {
+            if ((gen = strstr(line, "Gen=")) != NULL) {
+                b->gen = strtoull(gen + strlen("Gen="), NULL, 10);
+            }
+        }
+        else if (sscanf(line, " x = %d , y = %d", &cols, &rows) != 2 || rows <= 0 || cols <= 0) {
+            return WW_ERROR_FORMAT;
+        }
+    }
+    if (rows < 0) {
+        return WW_ERROR_FORMAT;
+    }
+
+    b->rows = rows;
+    b->cols = cols;
+    if ((b->cells = (state *)malloc((size_t)rows * cols)) == NULL) {
+        return WW_ERROR_MEMORY;
+    }
+    memset(b->cells, EMPTY, (size_t)rows * cols);
+
+    row = col = count = 0;
+    while ((c = getc(fp)) != EOF && c != RLE_END) {
+        if (c >= '0' && c <= '9') {
+            count = count * 10 + (c - '0');
+        }
+        else if (c == RLE_END_ROW) {
+            row += (count == 0) ? 1 : count;
+            col = count = 0;
+        }
+        else if (c != '\0' && (code = strchr(RLE_STATES, c)) != NULL) {
+            count = (count == 0) ? 1 : count;
+            /* the pattern is bigger than its header */
+            if (row >= rows || col + count > cols) {
+                free(b->cells);
+                return WW_ERROR_FORMAT;
+            }
+            memset(b->cells + (size_t)row * cols + col, cells[code - RLE_STATES], count);
+            col += count;
+            count = 0;
+        }
+        else if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+            free(b->cells);
+            return WW_ERROR_CHARACTER;
+        }
+    }
+
+    return WW_OK;
+
+} /* end read_rle */
+
+/* Maps a packed file straight into memory. The cells are 2 bits each, 
+4 to a byte, so each byte is turned into its 4 cells with one lookup 
+in a table rather than being parsed */
+static int load_packed(const char *filename, Board *b)
+{
+
+    /* built on the stack each call, so loads on several threads don't share it */
+    state table[MAX_BYTE][CELLS_PER_BYTE];
+    state cells[] = {EMPTY, ELECTRON_HEAD, ELECTRON_TAIL, CONDUCTOR};
+    unsigned char *data;
+    struct stat st;
+    size_t size, i, num_cells;
+    int fd, byte, k;
+
+    for (byte = 0; byte < MAX_BYTE; byte++) {
+        for (k = 0; k < CELLS_PER_BYTE; k++) {
+            table[byte][k] = cells[(byte >> (k * BITS_PER_CELL)) & CELL_MASK];
+        }
+    }
+
+    if ((fd = open(filename, O_RDONLY)) < 0) {
+        return WW_ERROR_OPEN;
+    }
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return WW_ERROR_OPEN;
+    }
+    size = (size_t)st.st_size;
+    if (size < PACKED_HEADER_SIZE || 
+        (data = (unsigned char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        close(fd);
+        return WW_ERROR_FORMAT;
+    }
+    close(fd);
+
+    b->rows = (int)get_le(data + PACKED_MAGIC_LENGTH, 4);
+    b->cols = (int)get_le(data + PACKED_MAGIC_LENGTH + 4, 4);
+    b->gen = get_le(data + PACKED_MAGIC_LENGTH + 8, 8);
+    num_cells = (size_t)b->rows * b->cols;
+    if (b->rows <= 0 || b->cols <= 0 || 
+        size < PACKED_HEADER_SIZE + (num_cells + CELLS_PER_BYTE - 1) / CELLS_PER_BYTE) {
+        /* the file is cut short */
+        munmap(data, size);
+        return WW_ERROR_FORMAT;
+    }
+
+    /* the cells array is rounded up to a whole byte's worth of cells */
+    if ((b->cells = (state *)malloc(num_cells + CELLS_PER_BYTE)) == NULL) {
+        munmap(data, size);
+        return WW_ERROR_MEMORY;
+    }
+    for (i = 0; i < (num_cells + CELLS_PER_BYTE - 1) / CELLS_PER_BYTE; i++) {
+        memcpy(b->cells + i * CELLS_PER_BYTE, table[data[PACKED_HEADER_SIZE + i]], CELLS_PER_BYTE);
+    }
+
+    munmap(data, size);
+
+    return WW_OK;
+
+} /* end load_packed */
+
+#ifndef WW_LIBRARY
+/* Saves a board as RLE if the filename ends in .rle, packed if not. 
+It is written to a temporary file which then replaces the old one, 
+so a run stopped part way through a save keeps its last checkpoint */
+static void save_board(char *filename, Board *b)
+{
+
+    FILE *fp;
+    char *temp;
+    size_t length;
+
+    length = strlen(filename);
+    temp = (char *)allocate_memory(length + strlen(".tmp") + 1);
+    sprintf(temp, "%s.tmp", filename);
+
+    if ((fp = fopen(temp, "wb")) == NULL) {
+        fprintf(stderr, "Error: Cannot open file\n");
+        exit(EXIT_FAILURE);
+    }
+    if (length >= strlen(RLE_EXTENSION) && 
+        strcmp(filename + length - strlen(RLE_EXTENSION), RLE_EXTENSION) == 0) {
+        write_rle(fp, b);
+    }
+    else {
+        write_packed(fp, b);
+    }
+    if (fclose(fp) != 0 || rename(temp, filename) != 0) {
+        fprintf(stderr, "Error: Cannot save board\n");
+        exit(EXIT_FAILURE);
+    }
+
+    free(temp);
+
+} /* end save_board */
+
+/* writes one run of an RLE file, starting a new line before it goes 
+past RLE_LINE_LENGTH characters */
+static void write_rle_run(FILE *fp, int count, char c, int *line_length)
+{
+
+    char run[MAX_LINE];
+    int n;
+
+    if (count == 1) {
+        n = sprintf(run, "%c", c);
+    }
+    else {
+        n = sprintf(run, "%d%c", count, c);
+    }
+    if (*line_length + n > RLE_LINE_LENGTH) {
+        putc('\n', fp);
+        *line_length = 0;
+    }
+    fputs(run, fp);
+    *line_length += n;
+
+} /* end write_rle_run */
+
+static void write_rle(FILE *fp, Board *b)
+{
+
+    int row, col, end, count, line_length, last_row;
+    state c;
+
+    fprintf(fp, "#CXRLE Pos=0,0 Gen=%llu\n", b->gen);
+    fprintf(fp, "x = %d, y = %d, rule = WireWorld\n", b->cols, b->rows);
+
+    line_length = 0;
+    last_row = 0;
+    for (row = 0; row < b->rows; row++) {
+        /* empty cells at the end of a row, and empty rows, are left out */
+        for (end = b->cols; end > 0 && b->cells[row * b->cols + end - 1] == EMPTY; end--) {
+            ;
+        }
+        if (end == 0) {
+            continue;
+        }
+        if (row > last_row) {
+            write_rle_run(fp, row - last_row, RLE_END_ROW, &line_length);
+        }
+        last_row = row;
+        for (col = 0; col < end; col += count) {
+            c = b->cells[row * b->cols + col];
+            for (count = 1; col + count < end && b->cells[row * b->cols + col + count] == c; count++) {
+                ;
+            }
+            write_rle_run(fp, count, RLE_STATES[cell_code(c)], &line_length);
+        }
+    }
+    fprintf(fp, "%c\n", RLE_END);
+
+} /* end write_rle */
+
+/* a header of PACKED_MAGIC, rows, cols and generation, in little 
+endian order, then the cells 4 to a byte */
+static void write_packed(FILE *fp, Board *b)
+{
+
+    size_t i, num_cells;
+    int byte, k;
+
+    fwrite(PACKED_MAGIC, 1, PACKED_MAGIC_LENGTH, fp);
+    put_le(fp, b->rows, 4);
+    put_le(fp, b->cols, 4);
+    put_le(fp, b->gen, 8);
+
+    num_cells = (size_t)b->rows * b->cols;
+    for (i = 0; i < num_cells; i += CELLS_PER_BYTE) {
+        byte = 0;
+        for (k = 0; k < CELLS_PER_BYTE && i + k < num_cells; k++) {
+            byte |= cell_code(b->cells[i + k]) << (k * BITS_PER_CELL);
+        }
+        putc(byte, fp);
+    }
+
+} /* end write_packed */
+
+static void put_le(FILE *fp, generation n, int num_bytes)
+{
+
+    int i;
+
+    for (i = 0; i < num_bytes; i++) {
+        putc((int)((n >> (8 * i)) & 0xFF), fp);
+    }
+
+} /* end put_le */
+#endif
+
+static generation get_le(unsigned char *bytes, int num_bytes)
+{
+
+    generation n = 0;
+    int i;
+
+    for (i = num_bytes - 1; i >= 0; i--) {
+        n = (n << 8) | bytes[i];
+    }
+
+    return n;
+
+} /* end get_le */
+
+#if !defined(WW_LIBRARY) && !defined(WW_NO_ANIMATION)
+static void set_colors(NCURS_Simplewin *sw)
+{
+
+    /* Function  sets the background color based on specific characters */
+    Neill_NCURS_CharStyle(sw, "t", COLOR_RED, COLOR_RED, A_NORMAL);
+    Neill_NCURS_CharStyle(sw, "c", COLOR_YELLOW, COLOR_YELLOW, A_NORMAL);
+    Neill_NCURS_CharStyle(sw, "H", COLOR_BLUE, COLOR_BLUE, A_NORMAL);
+    Neill_NCURS_CharStyle(sw, " ", COLOR_BLACK, COLOR_BLACK, A_NORMAL);
+    Neill_NCURS_CharStyle(sw, "\n", COLOR_BLACK, COLOR_BLACK, A_NORMAL); 
+
+} /* end set_colors */
+#endif
+
+/* checks to see if any characters bar ' ', 't', 'H'
+'c' and '\n' are present in the file */
+static int check_characters(char c)
+{
+
+    if (VALID_CHARACTERS) {
+        return VALID; 
+    }
+    else {
+        return INVALID; 
+    }
+
+} /* end check_characters */
+
+#ifndef WW_LIBRARY
+static void add_rules(state arr[][MAX_COLS], state new_arr[][MAX_COLS])
+{
+
+    int row, col;
+
+    /* copies entire board over to a new array, then 
+    changes the  characters in array based on rules set */
+    for (row = 0; row < MAX_ROWS; row++) {
+        for (col = 0; col < MAX_COLS; col++) {
+            copy_element(arr, new_arr, row, col);
+            apply_rules(arr, new_arr, row, col); 
+        }
+    }
+
+} /* end add_rules */
+
+static void copy_element(state arr[][MAX_COLS], state new_arr[][MAX_COLS], int row, int col)
+{
+
+    new_arr[row][col] = arr[row][col]; 
+
+} /* end copy_array */
+
+static void apply_rules(state arr[][MAX_COLS], state new_arr[][MAX_COLS], int row, int col)
+{
+
+    /* access_array_oob returns arr[row][col] if elements are 
+    within the array */
+    if (access_array_oob(arr, row, col) == ELECTRON_HEAD) {
+        new_arr[row][col] = ELECTRON_TAIL; 
+    }
+    else if (access_array_oob(arr, row, col) == ELECTRON_TAIL) {
+        new_arr[row][col] = CONDUCTOR;
+    }
+    else if (access_array_oob(arr, row, col) == EMPTY) {
+        new_arr[row][col] = EMPTY;
+    }
+    else if (access_array_oob(arr, row, col) == CONDUCTOR) {
+        /* If number electron heads is 1 or 2, 'c' becomes 'H' */
+        if (num_electron_heads(arr, row, col) == CORRECT_NUM) {
+            new_arr[row][col] = ELECTRON_HEAD; 
+        }
+        else { /* no change */
+            new_arr[row][col] = CONDUCTOR;
+        }
+    }
+    else {
+        new_arr[row][col] = arr[row][col]; 
+    }
+
+} /* end apply_rules */
+
+/* Will exit the program if, for some reason, the array was 
+accessed out of bounds, i.e. < 0 or > 40 */
+static int access_array_oob(state a[][MAX_COLS], int row, int col)
+{
+
+    /* exits program if array goes out of bounds, otherwise returns
+    the element of the 2D arary */
+    if ((col < 0) ||  (row < 0) || (col >= MAX_COLS) || (row >= MAX_ROWS)) {
+        fprintf(stderr, "Error: accessed an array out of bounds\n");
+        exit (EXIT_FAILURE); 
+    }
+    else {
+        return a[row][col]; 
+    }
+
+} /* end access_array_oob */
+
+static int num_electron_heads(state a[][MAX_COLS], int row, int col)
+{
+
+    int num_heads; /* number of electron heads */
+
+    /* check the 8 neighbouring cells against the current cell */
+    check_neighbouring_cells(a, row, col, &num_heads);
+
+    if (num_heads == 1 || num_heads == 2) {
+        return 1; /* changes 'c' to 'H' */
+    }
+    else {
+        return 0; /* no change */
+    }
+
+} /* end num_electron_heads */
+
+/* This function will check the 8 neighbouring cells of a[r][c].
+If the cells being checked are out of bounds, or is the cell 
+itself, it will be ignored */
+static void check_neighbouring_cells(state a[][MAX_COLS], int row, int col, int* pNum)
+{
+
+    int i, j; 
 
     i = -1;
     *pNum = 0; /* pointer to number of electron heads */
 
-    /* check cells from a[i - 1][j - 1] to a[i + 1][j + 1]*/
-    while (i < CELL_ROW_LIMIT) {
-        j = -1; /* start from column j - 1*/
-        while (j < CELL_COL_LIMIT) {
-            /* skip cell if checking out of bounds, e.g. a[-1][-1] */
-            if ((check_cell_oob(row + i, col + j)) == OUT_OF_BOUNDS) {
-                j++;              
+    /* check cells from a[i - 1][j - 1] to a[i + 1][j + 1]*/
+    while (i < CELL_ROW_LIMIT) {
+        j = -1; /* start from column j - 1*/
+        while (j < CELL_COL_LIMIT) {
+            /* skip cell if checking out of bounds, e.g. a[-1][-1] */
+            if ((check_cell_oob(row + i, col + j)) == OUT_OF_BOUNDS) {
+                j++;              
+            }
+            /* skip the middle cell (the one being compared against) */
+            else if (i == 0 && j == 0) {
+                j++;                 
+            }
+            else {
+                /* if cell contains 'H' add to total number of heads */
+                if (a[row + i][col + j] == ELECTRON_HEAD) {
+                    INCREMENT_NUM_HEADS; 
+                }
+            j++; 
+            } 
+        } 
+        i++; 
+    } 
+
+} /* end check_neighbouring_cells */
+
+/* This function determines whether a cell has been accessed which
+is out of bounds of the array, i.e. < 0 or > 40 */
+static int check_cell_oob(int row, int col)
+{
+
+    if ((col < 0) ||  (row < 0) || (col >= MAX_COLS) || (row >= MAX_ROWS)) {
+        return OUT_OF_BOUNDS;  
+    }
+    else {
+        return IN_RANGE;  
+    }
+
+} /* end check_cell_oob */
+
+static void copy_array(state new_arr[][MAX_COLS], state arr[][MAX_COLS])
+{
+
+    int row, col;
+
+    for (row = 0; row < MAX_ROWS; row++) {
+        for (col = 0; col < MAX_COLS; col++) {
+            arr[row][col] = new_arr[row][col]; 
+        } 
+    }
+
+} /* end copy_array */
+
+/* allocates size bytes, exiting the program if there is not 
+enough memory */
+static void *allocate_memory(size_t size)
+{
+
+    void *p;
+
+    if ((p = malloc(size)) == NULL) {
+        fprintf(stderr, "Error: Cannot allocate space. Not enough memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return p;
+
+} /* end allocate_memory */
+#endif
+
+/* electron heads and tails are conductors that are carrying a signal */
+static int is_conductor(state c)
+{
+
+    return (c == CONDUCTOR || c == ELECTRON_HEAD || c == ELECTRON_TAIL);
+
+} /* end is_conductor */
+
+/* This function builds the conductor graph of a board which is rows 
+by cols in size. Each conductor gets an index in row order, then the 
+indexes of its (up to 8) conductor neighbours are stored in the CSR 
+arrays. It returns WW_ERROR_MEMORY, with nothing left allocated, if 
+the arrays will not fit */
+static int compile_graph(Graph *g, state *board, int rows, int cols, Rule *rule)
+{
+
+    int row, col, i, j, k, n, cell; 
+    int *index; /* index of the conductor at each board position */
+
+    if ((index = (int *)malloc(sizeof(int) * rows * cols)) == NULL) {
+        return WW_ERROR_MEMORY;
+    }
+
+    /* number the conductors in row order */
+    g->num_cells = 0;
+    for (cell = 0; cell < rows * cols; cell++) {
+        index[cell] = is_conductor(board[cell]) ? g->num_cells++ : NOT_A_CONDUCTOR;
+    }
+
+    g->position = (int *)malloc(sizeof(int) * (g->num_cells + 1));
+    g->first_neighbour = (int *)malloc(sizeof(int) * (g->num_cells + 1));
+    g->cells = (state *)malloc(g->num_cells + 1);
+    g->new_cells = (state *)malloc(g->num_cells + 1);
+    g->neighbours = NULL;
+    g->rule = rule;
+    if (g->position == NULL || g->first_neighbour == NULL || 
+        g->cells == NULL || g->new_cells == NULL) {
+        free(index);
+        free_graph(g);
+        return WW_ERROR_MEMORY;
+    }
+    /* the extra byte (there so an empty graph still gets memory) is 
+    never stepped, but is given a state so it is never read unset */
+    g->cells[g->num_cells] = g->new_cells[g->num_cells] = EMPTY;
+
+    /* first pass counts the neighbours so the CSR arrays can be sized */
+    n = 0;
+    for (cell = 0; cell < rows * cols; cell++) {
+        if (index[cell] == NOT_A_CONDUCTOR) {
+            continue;
+        }
+        row = cell / cols;
+        col = cell % cols; 
+        g->position[index[cell]] = cell;
+        g->cells[index[cell]] = board[cell];
+        g->first_neighbour[index[cell]] = n;
+        for (k = 0; k < rule->num_offsets; k++) {
+            i = rule->row_offset[k];
+            j = rule->col_offset[k];
+            if (row + i >= 0 && row + i < rows && col + j >= 0 && col + j < cols && 
+                index[(row + i) * cols + col + j] != NOT_A_CONDUCTOR) {
+                n++;
+            }
+        }
+    }
+    g->first_neighbour[g->num_cells] = n;
+
+    /* second pass fills in the neighbour indexes */
+    if ((g->neighbours = (int *)malloc(sizeof(int) * (n + 1))) == NULL) {
+        free(index);
+        free_graph(g);
+        return WW_ERROR_MEMORY;
+    }
+    n = 0;
+    for (cell = 0; cell < rows * cols; cell++) {
+        if (index[cell] == NOT_A_CONDUCTOR) {
+            continue;
+        }
+        row = cell / cols;
+        col = cell % cols; 
+        for (k = 0; k < rule->num_offsets; k++) {
+            i = rule->row_offset[k];
+            j = rule->col_offset[k];
+            if (row + i >= 0 && row + i < rows && col + j >= 0 && col + j < cols && 
+                index[(row + i) * cols + col + j] != NOT_A_CONDUCTOR) {
+                g->neighbours[n++] = index[(row + i) * cols + col + j];
+            }
+        }
+    }
+
+    free(index);
+
+    return WW_OK;
+
+} /* end compile_graph */
+
+/* Applies the graph's rule to every conductor in it */
+static void step_graph(Graph *g)
+{
+
+    state *temp; 
+
+    step_cells(g, g->cells, g->new_cells);
+
+    /* new generation becomes the current one */
+    temp = g->cells;
+    g->cells = g->new_cells;
+    g->new_cells = temp;
+
+} /* end step_graph */
+
+/* Works out the next generation of cells into new_cells with the 
+graph's rule - for wireworld 'H' becomes 't', 't' becomes 'c' and 'c' 
+becomes 'H' if 1 or 2 of its neighbours are electron heads. The 
+cells do not have to be the graph's own, so several generations can 
+be kept at once */
+static void step_cells(Graph *g, state *cells, state *new_cells)
+{
+
+    g->rule->step(g, cells, new_cells);
+
+} /* end step_cells */
+
+/* each rule's table, and its stepping function built around it */
+static const state wireworld_table[MAX_BYTE][NUM_NEIGHBOURS + 1] = RULE_TABLE(WIREWORLD_FIRES);
+static const state single_table[MAX_BYTE][NUM_NEIGHBOURS + 1] = RULE_TABLE(SINGLE_FIRES);
+
+DEFINE_STEP_KERNEL(step_wireworld, wireworld_table)
+DEFINE_STEP_KERNEL(step_von_neumann, wireworld_table)
+DEFINE_STEP_KERNEL(step_single, single_table)
+
+/* writes the conductors back into the board so it can be displayed. 
+Empty cells are never changed so are left as they are */
+static void graph_to_array(Graph *g, state *board)
+{
+
+    int i;
+
+    for (i = 0; i < g->num_cells; i++) {
+        board[g->position[i]] = g->cells[i];
+    }
+
+} /* end graph_to_array */
+
+static void free_graph(Graph *g)
+{
+
+    free(g->position);
+    free(g->first_neighbour);
+    free(g->neighbours);
+    free(g->cells);
+    free(g->new_cells);
+
+} /* end free_graph */
+
+#ifndef WW_LIBRARY
+/* Splits the graph into plain wires and the junctions between them. 
+A wire starts at a cell with exactly two neighbours, one of which is 
+not a wire cell, and is followed until it reaches another cell which 
+isn't. Whatever is left is a loop of wire with no junction on it, so 
+one of its cells is made a junction and the rest followed from it */
+static void delay_init(DelayGraph *d, Graph *g)
+{
+
+    int i, j, k, loop, cell, prev, next, length, first_end;
+    int *path; /* cells of the wire being followed */
+    char *placed; /* NOT_PLACED, PLACED_JUNCTION or PLACED_ON_WIRE */
+
+    d->g = g;
+    d->num_wires = d->num_junctions = 0;
+    d->wires = (WireSegment *)allocate_memory(sizeof(WireSegment) * 
+        (g->num_cells / MIN_WIRE_LENGTH + 1));
+    d->junctions = (int *)allocate_memory(sizeof(int) * (g->num_cells + 1));
+    path = (int *)allocate_memory(sizeof(int) * (g->num_cells + 1));
+    placed = (char *)allocate_memory(g->num_cells + 1);
+    memset(placed, NOT_PLACED, g->num_cells + 1);
+
+    for (loop = 0; loop < 2; loop++) {
+        for (i = 0; i < g->num_cells; i++) {
+            if (placed[i] != NOT_PLACED || !is_plain_wire(g, i)) {
+                continue;
+            }
+            j = g->neighbours[g->first_neighbour[i]];
+            k = g->neighbours[g->first_neighbour[i] + 1];
+            if (loop == 0 && is_plain_wire(g, j) && is_plain_wire(g, k)) {
+                continue; 
+            }
+            if (loop == 0) {
+                /* from the junction at one end */
+                prev = is_plain_wire(g, j) ? k : j;
+                cell = i;
+            }
+            else {
+                placed[i] = PLACED_JUNCTION;
+                prev = i;
+                cell = j;
+            }
+            first_end = prev;
+
+            length = 0;
+            while (placed[cell] == NOT_PLACED && is_plain_wire(g, cell)) {
+                path[length++] = cell;
+                placed[cell] = PLACED_JUNCTION;
+                next = g->neighbours[g->first_neighbour[cell]];
+                if (next == prev) {
+                    next = g->neighbours[g->first_neighbour[cell] + 1];
+                }
+                prev = cell;
+                cell = next;
+            }
+            if (length >= MIN_WIRE_LENGTH) {
+                add_wire(d, path, length, first_end, cell, placed);
+            }
+        }
+    }
+
+    /* junctions are stepped in conductor order, as the graph engine would */
+    for (i = 0; i < g->num_cells; i++) {
+        if (placed[i] != PLACED_ON_WIRE) {
+            d->junctions[d->num_junctions++] = i;
+        }
+    }
+
+    free(path);
+    free(placed);
+
+} /* end delay_init */
+
+/* a cell on a plain wire has exactly two neighbours */
+static int is_plain_wire(Graph *g, int i)
+{
+
+    return (g->first_neighbour[i + 1] - g->first_neighbour[i] == 2);
+
+} /* end is_plain_wire */
+
+/* keeps the cells of path as a wire, with their signals as bits */
+static void add_wire(DelayGraph *d, int *path, int length, int first_end, int last_end, char *placed)
+{
+
+    WireSegment *w = &d->wires[d->num_wires++];
+    state c;
+    int k;
+
+    w->length = length;
+    w->cells = (int *)allocate_memory(sizeof(int) * length);
+    memcpy(w->cells, path, sizeof(int) * length);
+    w->ends[0] = first_end;
+    w->ends[1] = last_end;
+    w->words = (length + LANE_BITS - 1) / LANE_BITS;
+    w->heads = (lane *)allocate_memory(sizeof(lane) * w->words);
+    w->tails = (lane *)allocate_memory(sizeof(lane) * w->words);
+    w->spare = (lane *)allocate_memory(sizeof(lane) * w->words);
+    memset(w->heads, 0, sizeof(lane) * w->words);
+    memset(w->tails, 0, sizeof(lane) * w->words);
+    w->active = 0;
+
+    for (k = 0; k < length; k++) {
+        placed[path[k]] = PLACED_ON_WIRE;
+        c = d->g->cells[path[k]];
+        if (c == ELECTRON_HEAD) {
+            w->heads[k / LANE_BITS] |= (lane)1 << (k % LANE_BITS);
+            w->active = 1;
+        }
+        else if (c == ELECTRON_TAIL) {
+            w->tails[k / LANE_BITS] |= (lane)1 << (k % LANE_BITS);
+            w->active = 1;
+        }
+    }
+
+} /* end add_wire */
+
+/* Works out the next generation - the junctions a cell at a time 
+under the wireworld rules, then each wire from the cells at its ends */
+static void delay_step(DelayGraph *d)
+{
+
+    Graph *g = d->g;
+    state *temp;
+    int i, j, k, num_heads;
+
+    for (j = 0; j < d->num_junctions; j++) {
+        i = d->junctions[j];
+        num_heads = 0;
+        for (k = g->first_neighbour[i]; k < g->first_neighbour[i + 1]; k++) {
+            num_heads += (g->cells[g->neighbours[k]] == ELECTRON_HEAD);
+        }
+        g->new_cells[i] = wireworld_table[(unsigned char)g->cells[i]][num_heads];
+    }
+    for (i = 0; i < d->num_wires; i++) {
+        step_wire(&d->wires[i], g->cells, g->new_cells);
+    }
+
+    /* new generation becomes the current one */
+    temp = g->cells;
+    g->cells = g->new_cells;
+    g->new_cells = temp;
+
+} /* end delay_step */
+
+/* Moves a wire on a generation. Cell k becomes a head if cell k - 1 
+or k + 1 (the junctions, past the ends) is a head and cell k is 
+neither a head nor a tail, and this generation's heads are next 
+generation's tails. Signals going each way, and what happens when 
+they meet, all come out of that. A wire with no signal on it, and 
+none coming in, is not looked at */
+static void step_wire(WireSegment *w, state *cells, state *new_cells)
+{
+
+    lane *heads = w->heads, *tails = w->tails, *next = w->spare;
+    lane left, right, first_in, last_in, last_mask, any = 0;
+    int k, last = w->words - 1, top = (w->length - 1) % LANE_BITS;
+
+    first_in = (cells[w->ends[0]] == ELECTRON_HEAD);
+    last_in = (cells[w->ends[1]] == ELECTRON_HEAD);
+    if (!w->active && !first_in && !last_in) {
+        new_cells[w->cells[0]] = new_cells[w->cells[w->length - 1]] = CONDUCTOR;
+        return;
+    }
+    last_mask = (top == LANE_BITS - 1) ? ~(lane)0 : ((lane)1 << (top + 1)) - 1;
+
+    for (k = 0; k <= last; k++) {
+        left = (heads[k] << 1) | ((k > 0) ? heads[k - 1] >> (LANE_BITS - 1) : first_in);
+        right = (heads[k] >> 1) | ((k < last) ? heads[k + 1] << (LANE_BITS - 1) : last_in << top);
+        next[k] = (left | right) & ~heads[k] & ~tails[k] & ((k < last) ? ~(lane)0 : last_mask);
+        any |= next[k] | heads[k];
+    }
+
+    /* the end cells are what the junctions see */
+    new_cells[w->cells[0]] = wire_cell(next, heads, 0);
+    new_cells[w->cells[w->length - 1]] = wire_cell(next, heads, w->length - 1);
+
+    w->spare = tails;
+    w->tails = heads;
+    w->heads = next;
+    w->active = (any != 0);
+
+} /* end step_wire */
+
+/* the state of cell k of a wire */
+static state wire_cell(lane *heads, lane *tails, int k)
+{
+
+    if ((heads[k / LANE_BITS] >> (k % LANE_BITS)) & 1) {
+        return ELECTRON_HEAD;
+    }
+    if ((tails[k / LANE_BITS] >> (k % LANE_BITS)) & 1) {
+        return ELECTRON_TAIL;
+    }
+
+    return CONDUCTOR;
+
+} /* end wire_cell */
+
+/* writes every conductor, wires included, back into the board */
+static void delay_to_array(DelayGraph *d, state *board)
+{
+
+    WireSegment *w;
+    int i, k;
+
+    for (i = 0; i < d->num_wires; i++) {
+        w = &d->wires[i];
+        for (k = 0; k < w->length; k++) {
+            d->g->cells[w->cells[k]] = wire_cell(w->heads, w->tails, k);
+        }
+    }
+    graph_to_array(d->g, board);
+
+} /* end delay_to_array */
+
+/* bytes taken by the wires and junction list, on top of the graph */
+static size_t delay_memory(DelayGraph *d)
+{
+
+    size_t memory;
+    int i;
+
+    memory = graph_memory(d->g) + (size_t)(d->g->num_cells + 1) * sizeof(int) + 
+        (size_t)(d->g->num_cells / MIN_WIRE_LENGTH + 1) * sizeof(WireSegment);
+    for (i = 0; i < d->num_wires; i++) {
+        memory += (size_t)d->wires[i].length * sizeof(int) + 
+            (size_t)d->wires[i].words * 3 * sizeof(lane);
+    }
+
+    return memory;
+
+} /* end delay_memory */
+
+static void delay_free(DelayGraph *d)
+{
+
+    int i;
+
+    for (i = 0; i < d->num_wires; i++) {
+        free(d->wires[i].cells);
+        free(d->wires[i].heads);
+        free(d->wires[i].tails);
+        free(d->wires[i].spare);
+    }
+    free(d->wires);
+    free(d->junctions);
+
+} /* end delay_free */
+
+/* Runs opts->batch_gens generations of b as stripes, one process 
+each, sharing only the halo rows and the board they are gathered in 
+for output. The first stripe writes the boards and saves, so the 
+output is the same as run_batch's whatever the number of processes. 
+Each stripe's cells are allocated after it is forked, so on a machine 
+with several sockets they are in the memory next to where it runs */
+static void run_stripes(Options *opts, Board *b)
+{
+
+    StripeSet ss;
+    pid_t *pids;
+    char name[MAX_SHM_NAME];
+    char *shared;
+    size_t halo_bytes, size;
+    double start, wall_time, cells;
+    int fd, i, status, failed = 0;
+
+    setvbuf(stdout, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+    if (opts->batch_gens == 0) {
+        write_board(stdout, b->cells, b->rows, b->cols);
+        fflush(stdout);
+        if (opts->save_file != NULL) {
+            save_board(opts->save_file, b);
+        }
+        return;
+    }
+
+    /* every stripe needs a row, and as many rows as its halo is deep */
+    ss.processes = (opts->processes < b->rows) ? opts->processes : b->rows;
+    ss.halo = (opts->halo < b->rows / ss.processes) ? opts->halo : b->rows / ss.processes;
+    ss.rows = b->rows;
+    ss.cols = b->cols;
+    halo_bytes = (size_t)2 * ss.processes * 2 * ss.halo * ss.cols;
+    size = sizeof(StripeHeader) + halo_bytes + (size_t)ss.rows * ss.cols;
+
+    snprintf(name, MAX_SHM_NAME, "/wireworld-%ld", (long)getpid());
+    if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR)) < 0) {
+        fprintf(stderr, "Error: Cannot create shared memory\n");
+        exit(EXIT_FAILURE);
+    }
+    if (ftruncate(fd, size) != 0 || 
+        (shared = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        shm_unlink(name);
+        fprintf(stderr, "Error: Cannot allocate space. Not enough memory\n");
+        exit(EXIT_FAILURE);
+    }
+    /* the processes share the mapping, so the name is not needed */
+    shm_unlink(name);
+    close(fd);
+    ss.header = (StripeHeader *)shared;
+    ss.halos = shared + sizeof(StripeHeader);
+    ss.board = ss.halos + halo_bytes;
+
+    pids = (pid_t *)allocate_memory(sizeof(pid_t) * ss.processes);
+    fflush(stderr);
+    start = seconds_now();
+    for (i = 0; i < ss.processes; i++) {
+        if ((pids[i] = fork()) < 0) {
+            failed = 1;
+            break;
+        }
+        if (pids[i] == 0) {
+            run_stripe(&ss, opts, b, i);
+            exit(EXIT_SUCCESSFUL);
+        }
+    }
+
+    /* a stripe which fails leaves the rest waiting at the barrier 
+    for ever, so they are stopped */
+    for (i = 0; i < ss.processes && !failed; i++) {
+        if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESSFUL) {
+            failed = 1;
+        }
+    }
+    if (failed) {
+        for (i = 0; i < ss.processes && pids[i] > 0; i++) {
+            kill(pids[i], SIGTERM);
+        }
+        while (wait(NULL) > 0) {
+            continue;
+        }
+        fprintf(stderr, "Error: A stripe process failed\n");
+        exit(EXIT_FAILURE);
+    }
+    wall_time = seconds_now() - start;
+
+    fprintf(stderr, "%llu generations in %.3f s (%.3f s simulating)\n", 
+        opts->batch_gens, wall_time, ss.header->sim_time);
+    cells = (double)b->rows * b->cols;
+    if (ss.header->sim_time > 0) {
+        fprintf(stderr, "%.4g cell updates/sec over %d processes\n", 
+            cells * opts->batch_gens / ss.header->sim_time, ss.processes);
+    }
+
+    munmap(shared, size);
+    free(pids);
+
+} /* end run_stripes */
+
+/* What each stripe process does. Generations are run halo at a time 
+(fewer if a board is to be written or saved sooner), after swapping 
+halo rows with the stripes above and below. Each generation works 
+out one row less at each end, as the outermost halo row has no 
+neighbours to go on, so after halo generations just the stripe's 
+own rows are right */
+static void run_stripe(StripeSet *ss, Options *opts, Board *b, int index)
+{
+
+    Stripe s;
+    Board out;
+    state *temp;
+    generation done, chunk, j, start_gen = b->gen;
+    double tick, sim_time = 0;
+    size_t size;
+    int row, sense = 0, slot = 0, frames = 0, height;
+
+    s.index = index;
+    s.first_row = (int)((long long)index * ss->rows / ss->processes);
+    s.num_rows = (int)((long long)(index + 1) * ss->rows / ss->processes) - s.first_row;
+    s.width = ss->cols + 2;
+    height = s.num_rows + 2 * ss->halo;
+    size = (size_t)height * s.width;
+    s.cells = (state *)allocate_memory(size);
+    s.new_cells = (state *)allocate_memory(size);
+    memset(s.cells, EMPTY, size);
+    memset(s.new_cells, EMPTY, size);
+    for (row = 0; row < s.num_rows; row++) {
+        memcpy(s.cells + (size_t)(ss->halo + row) * s.width + 1, 
+            b->cells + (size_t)(s.first_row + row) * ss->cols, ss->cols);
+    }
+
+    done = 0;
+    while (done < opts->batch_gens) {
+        chunk = opts->batch_gens - done;
+        if (opts->interval != FINAL_ONLY && opts->interval - done % opts->interval < chunk) {
+            chunk = opts->interval - done % opts->interval;
+        }
+        if (opts->checkpoint != NO_CHECKPOINTS && opts->checkpoint - done % opts->checkpoint < chunk) {
+            chunk = opts->checkpoint - done % opts->checkpoint;
+        }
+        if ((generation)ss->halo < chunk) {
+            chunk = ss->halo;
+        }
+
+        exchange_halos(ss, &s, slot, &sense);
+        slot = !slot;
+        tick = seconds_now();
+        for (j = 1; j <= chunk; j++) {
+            step_stripe(&s, (int)j, height - 1 - (int)j);
+            temp = s.cells;
+            s.cells = s.new_cells;
+            s.new_cells = temp;
+        }
+        sim_time += seconds_now() - tick;
+        done += chunk;
+
+        if ((opts->interval != FINAL_ONLY && done % opts->interval == 0) || 
+            (opts->checkpoint != NO_CHECKPOINTS && done % opts->checkpoint == 0) || 
+            done == opts->batch_gens) {
+            for (row = 0; row < s.num_rows; row++) {
+                memcpy(ss->board + (size_t)(s.first_row + row) * ss->cols, 
+                    s.cells + (size_t)(ss->halo + row) * s.width + 1, ss->cols);
+            }
+            /* no stripe can write the board again before the first 
+            has written it out, as that is after the next exchange */
+            stripe_barrier(ss->header, ss->processes, &sense);
+        }
+        if (index == 0 && ((opts->interval != FINAL_ONLY && done % opts->interval == 0) || 
+            done == opts->batch_gens)) {
+            /* boards are separated by a blank line */
+            if (frames++ > 0) {
+                putchar('\n');
+            }
+            write_board(stdout, ss->board, ss->rows, ss->cols);
+        }
+        if (index == 0 && opts->save_file != NULL && (done == opts->batch_gens || 
+            (opts->checkpoint != NO_CHECKPOINTS && done % opts->checkpoint == 0))) {
+            out = *b;
+            out.cells = ss->board;
+            out.gen = start_gen + done;
+            save_board(opts->save_file, &out);
+        }
+    }
+    fflush(stdout);
+
+    if (index == 0) {
+        ss->header->sim_time = sim_time;
+    }
+    free(s.cells);
+    free(s.new_cells);
+
+} /* end run_stripe */
+
+/* the halo rows of one side of a stripe, in one of the two slots */
+static state *halo_slot(StripeSet *ss, int slot, int stripe, int side)
+{
+
+    return ss->halos + (((size_t)slot * ss->processes + stripe) * 2 + side) * ss->halo * ss->cols;
+
+} /* end halo_slot */
+
+/* puts the stripe's top and bottom halo rows in a slot, then once 
+every stripe has, fills its own halo rows from its neighbours' */
+static void exchange_halos(StripeSet *ss, Stripe *s, int slot, int *sense)
+{
+
+    size_t cols = ss->cols;
+    int row;
+
+    for (row = 0; row < ss->halo; row++) {
+        memcpy(halo_slot(ss, slot, s->index, TOP_HALO) + row * cols, 
+            s->cells + (size_t)(ss->halo + row) * s->width + 1, cols);
+        memcpy(halo_slot(ss, slot, s->index, BOTTOM_HALO) + row * cols, 
+            s->cells + (size_t)(s->num_rows + row) * s->width + 1, cols);
+    }
+
+    stripe_barrier(ss->header, ss->processes, sense);
+
+    for (row = 0; row < ss->halo; row++) {
+        if (s->index > 0) {
+            memcpy(s->cells + (size_t)row * s->width + 1, 
+                halo_slot(ss, slot, s->index - 1, BOTTOM_HALO) + row * cols, cols);
+        }
+        if (s->index < ss->processes - 1) {
+            memcpy(s->cells + (size_t)(ss->halo + s->num_rows + row) * s->width + 1, 
+                halo_slot(ss, slot, s->index + 1, TOP_HALO) + row * cols, cols);
+        }
+    }
+
+} /* end exchange_halos */
+
+/* The rules of add_rules for rows first to last of a stripe - a 
+conductor's next state is looked up from the heads in the 8 cells 
+around it. Empty cells never change, and are empty in both 
+generations already */
+static void step_stripe(Stripe *s, int first, int last)
+{
+
+    state *c;
+    size_t w = s->width;
+    int row, col, num_heads;
+
+    for (row = first; row <= last; row++) {
+        c = s->cells + (size_t)row * w;
+        for (col = 1; col < s->width - 1; col++) {
+            if (c[col] == EMPTY) {
+                continue;
+            }
+            num_heads = (c[col - w - 1] == ELECTRON_HEAD) + (c[col - w] == ELECTRON_HEAD) + 
+                (c[col - w + 1] == ELECTRON_HEAD) + (c[col - 1] == ELECTRON_HEAD) + 
+                (c[col + 1] == ELECTRON_HEAD) + (c[col + w - 1] == ELECTRON_HEAD) + 
+                (c[col + w] == ELECTRON_HEAD) + (c[col + w + 1] == ELECTRON_HEAD);
+            s->new_cells[(size_t)row * w + col] = wireworld_table[(unsigned char)c[col]][num_heads];
+        }
+    }
+
+} /* end step_stripe */
+
+/* Waits until every process has got here. The last one in resets 
+the count and flips the shared sense, which the others spin on */
+static void stripe_barrier(StripeHeader *h, int processes, int *sense)
+{
+
+    *sense = !*sense;
+    if (__atomic_add_fetch(&h->waiting, 1, __ATOMIC_ACQ_REL) == processes) {
+        __atomic_store_n(&h->waiting, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&h->sense, *sense, __ATOMIC_RELEASE);
+        return;
+    }
+    while (__atomic_load_n(&h->sense, __ATOMIC_ACQUIRE) != *sense) {
+        sched_yield();
+    }
+
+} /* end stripe_barrier */
+
+/* Random looking 64 bit number for conductor i being in state c. 
+A generation's hash is all of its cell keys XORed together */
+static unsigned long long cell_key(int i, state c)
+{
+
+    unsigned long long x;
+
+    /* splitmix64 finaliser */
+    x = ((unsigned long long)i << 8 | (unsigned char)c) + 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+
+    return x ^ (x >> 31);
+
+} /* end cell_key */
+
+static unsigned long long hash_cells(Graph *g, state *cells)
+{
+
+    int i;
+    unsigned long long hash = 0;
+
+    for (i = 0; i < g->num_cells; i++) {
+        hash ^= cell_key(i, cells[i]);
+    }
+
+    return hash;
+
+} /* end hash_cells */
+
+/* Only cells which changed between generations affect the hash, 
+so it is swapped from the old state's key to the new one's */
+static unsigned long long update_hash(Graph *g, state *cells, state *new_cells, unsigned long long hash)
+{
+
+    int i;
+
+    for (i = 0; i < g->num_cells; i++) {
+        if (cells[i] != new_cells[i]) {
+            hash ^= cell_key(i, cells[i]) ^ cell_key(i, new_cells[i]);
+        }
+    }
+
+    return hash;
+
+} /* end update_hash */
+
+/* Uses Brent's algorithm to find the period and pre-period of the 
+graph's current cells. Only one earlier generation (the tortoise) is 
+kept, and the full cells are only compared when the hashes match. 
+Returns INVALID, with the graph's cells set to generation target, if 
+target is reached before a cycle is found */
+static int find_cycle(Graph *g, generation target, Cycle *cy)
+{
+
+    state *tortoise, *hare, *next, *temp;
+    unsigned long long tortoise_hash, hare_hash;
+    generation power, lambda, hare_gen, mu, i;
+    size_t size = g->num_cells; /* the graph's sentinel byte is left out */
+
+    tortoise = (state *)allocate_memory(size + 1);
+    hare = (state *)allocate_memory(size + 1);
+    next = (state *)allocate_memory(size + 1);
+    cy->start = (state *)allocate_memory(size + 1);
+    memcpy(cy->start, g->cells, size);
+    memcpy(tortoise, g->cells, size);
+    memcpy(hare, g->cells, size);
+    tortoise_hash = hare_hash = hash_cells(g, hare);
+    power = 1; 
+    lambda = 0; 
+    hare_gen = 0;
+
+    /* hare runs ahead until it lands on the tortoise, which is moved up 
+    to the hare every time lambda reaches a power of two */
+    do {
+        if (hare_gen == target) {
+            memcpy(g->cells, hare, size);
+            free(tortoise); free(hare); free(next); free(cy->start);
+            return INVALID;
+        }
+        if (hare_gen >= MAX_CYCLE_SEARCH) {
+            fprintf(stderr, "Error: No cycle found in %llu generations\n", MAX_CYCLE_SEARCH);
+            exit(EXIT_FAILURE);
+        }
+        if (power == lambda) {
+            memcpy(tortoise, hare, size);
+            tortoise_hash = hare_hash;
+            power *= 2;
+            lambda = 0;
+        }
+        step_cells(g, hare, next);
+        hare_hash = update_hash(g, hare, next, hare_hash);
+        temp = hare; hare = next; next = temp;
+        hare_gen++;
+        lambda++;
+    } while (hare_hash != tortoise_hash || memcmp(hare, tortoise, size) != 0);
+    cy->period = lambda;
+
+    /* start the tortoise at generation 0 and the hare a period ahead. 
+    They first meet at the start of the cycle */
+    memcpy(tortoise, cy->start, size);
+    memcpy(hare, cy->start, size);
+    tortoise_hash = hare_hash = hash_cells(g, hare);
+    for (i = 0; i < cy->period; i++) {
+        step_cells(g, hare, next);
+        hare_hash = update_hash(g, hare, next, hare_hash);
+        temp = hare; hare = next; next = temp;
+    }
+    mu = 0;
+    while (hare_hash != tortoise_hash || memcmp(hare, tortoise, size) != 0) {
+        step_cells(g, tortoise, next);
+        tortoise_hash = update_hash(g, tortoise, next, tortoise_hash);
+        temp = tortoise; tortoise = next; next = temp;
+        step_cells(g, hare, next);
+        hare_hash = update_hash(g, hare, next, hare_hash);
+        temp = hare; hare = next; next = temp;
+        mu++;
+    }
+    cy->pre_period = mu;
+
+    /* keep every generation of the cycle if they fit, so each one is 
+    a single copy away */
+    cy->whole_orbit = (cy->period * size <= MAX_ORBIT_BYTES);
+    if (cy->whole_orbit) {
+        cy->orbit = (state *)allocate_memory(cy->period * size + 1);
+        for (i = 0; i < cy->period; i++) {
+            memcpy(cy->orbit + i * size, tortoise, size);
+            step_cells(g, tortoise, next);
+            temp = tortoise; tortoise = next; next = temp;
+        }
+    }
+    else {
+        cy->orbit = (state *)allocate_memory(size + 1);
+        memcpy(cy->orbit, tortoise, size);
+    }
+
+    free(tortoise); 
+    free(hare); 
+    free(next);
+
+    return VALID;
+
+} /* end find_cycle */
+
+/* steps cells forward n generations */
+static void advance_cells(Graph *g, state *cells, generation n)
+{
+
+    state *next, *current, *temp;
+    size_t size = g->num_cells; /* the graph's sentinel byte is left out */
+
+    next = (state *)allocate_memory(size + 1);
+    current = cells;
+    while (n-- > 0) {
+        step_cells(g, current, next);
+        temp = current; current = next; next = temp;
+    }
+    if (current != cells) {
+        memcpy(cells, current, size);
+        free(current);
+    }
+    else {
+        free(next);
+    }
+
+} /* end advance_cells */
+
+/* Sets the graph's cells to generation n using a cycle found by 
+find_cycle. Generations in the cycle cost at most one period of 
+steps, or none if the whole orbit was kept */
+static void cycle_state_at(Graph *g, Cycle *cy, generation n)
+{
+
+    generation offset;
+    size_t size = g->num_cells; /* the graph's sentinel byte is left out */
+
+    if (n < cy->pre_period) {
+        memcpy(g->cells, cy->start, size);
+        advance_cells(g, g->cells, n);
+        return;
+    }
+
+    offset = (n - cy->pre_period) % cy->period;
+    if (cy->whole_orbit) {
+        memcpy(g->cells, cy->orbit + offset * size, size);
+    }
+    else {
+        memcpy(g->cells, cy->orbit, size);
+        advance_cells(g, g->cells, offset);
+    }
+
+} /* end cycle_state_at */
+
+static void free_cycle(Cycle *cy)
+{
+
+    free(cy->start);
+    free(cy->orbit);
+
+} /* end free_cycle */
+
+/* prints generation n of the board, using the circuit's cycle 
+rather than simulating every generation up to n */
+static void jump_to_generation(Graph *g, generation n, Board *b)
+{
+
+    Cycle cy;
+
+    if (find_cycle(g, n, &cy) == VALID) {
+        fprintf(stderr, "Period %llu, pre-period %llu\n", cy.period, cy.pre_period);
+        cycle_state_at(g, &cy, n);
+        free_cycle(&cy);
+    }
+
+    graph_to_array(g, b->cells);
+    write_board(stdout, b->cells, b->rows, b->cols);
+
+} /* end jump_to_generation */
+
+/* prints generation n of the board, advancing it with HashLife */
+static void hashlife_generation(generation n, Board *b)
+{
+
+    HashLife h;
+
+    hl_init(&h, b->cells, b->rows, b->cols);
+    hl_advance(&h, n);
+    hl_write_board(&h, b->cells);
+    fprintf(stderr, "HashLife nodes in use: %d\n", h.num_nodes);
+    write_board(stdout, b->cells, b->rows, b->cols);
+
+    hl_free(&h);
+
+} /* end hashlife_generation */
+
+/* writes the root into a board which is h->rows by h->cols */
+static void hl_write_board(HashLife *h, state *board)
+{
+
+    /* empty nodes are skipped, so the board is cleared first */
+    memset(board, EMPTY, (size_t)h->rows * h->cols);
+    hl_to_array(h, h->root, -h->origin_row, -h->origin_col, board);
+
+} /* end hl_write_board */
+
+/* converts a cell to one of the four HashLife leaves */
+static int cell_code(state c)
+{
+
+    if (c == ELECTRON_HEAD) {
+        return HL_CELL_HEAD;
+    }
+    else if (c == ELECTRON_TAIL) {
+        return HL_CELL_TAIL;
+    }
+    else if (c == CONDUCTOR) {
+        return HL_CELL_CONDUCTOR;
+    }
+    else {
+        return HL_CELL_EMPTY;
+    }
+
+} /* end cell_code */
+
+/* Builds the quadtree for a board which is rows by cols in size. 
+The root is the smallest square node that covers the board */
+static void hl_init(HashLife *h, state *board, int rows, int cols)
+{
+
+    int i, level;
+
+    h->capacity = HL_INITIAL_NODES;
+    h->nodes = (HashNode *)allocate_memory(sizeof(HashNode) * h->capacity);
+    h->buckets = (int *)allocate_memory(sizeof(int) * h->capacity);
+    h->max_nodes = HL_MAX_NODES;
+    h->depth = 0;
+    h->rows = rows;
+    h->cols = cols;
+    h->origin_row = h->origin_col = 0;
+
+    /* the first four nodes are the leaves, and the rest are free */
+    h->free_list = NO_NODE;
+    for (i = h->capacity - 1; i >= 0; i--) {
+        h->nodes[i].level = (i < HL_NUM_LEAVES) ? 0 : HL_FREE;
+        h->nodes[i].result = NO_NODE;
+        h->nodes[i].marked = 0;
+        if (i >= HL_NUM_LEAVES) {
+            h->nodes[i].next = h->free_list;
+            h->free_list = i;
+        }
+    }
+    h->num_nodes = HL_NUM_LEAVES;
+    for (i = 0; i < h->capacity; i++) {
+        h->buckets[i] = NO_NODE;
+    }
+    for (i = 0; i <= HL_MAX_LEVEL; i++) {
+        h->empty[i] = NO_NODE;
+    }
+
+    for (level = HL_MIN_LEVEL; (1LL << level) < rows || (1LL << level) < cols; level++) {
+        ; 
+    }
+    h->root = hl_build(h, board, level, 0, 0);
+
+} /* end hl_init */
+
+static void hl_free(HashLife *h)
+{
+
+    free(h->nodes);
+    free(h->buckets);
+
+} /* end hl_free */
+
+/* Takes a node from the free list, doubling the node array (and the 
+hash table) when there are none left. Any HashNode pointers held by 
+the caller are no longer valid afterwards */
+static int hl_new_node(HashLife *h)
+{
+
+    int i, n;
+
+    if (h->free_list == NO_NODE) {
+        h->nodes = (HashNode *)realloc(h->nodes, sizeof(HashNode) * h->capacity * 2);
+        h->buckets = (int *)realloc(h->buckets, sizeof(int) * h->capacity * 2);
+        if (h->nodes == NULL || h->buckets == NULL) {
+            fprintf(stderr, "Error: Cannot allocate space. Not enough memory\n");
+            exit(EXIT_FAILURE);
+        }
+        for (i = h->capacity * 2 - 1; i >= h->capacity; i--) {
+            h->nodes[i].level = HL_FREE;
+            h->nodes[i].next = h->free_list;
+            h->free_list = i;
+        }
+        h->capacity *= 2;
+        hl_rehash(h);
+    }
+
+    n = h->free_list;
+    h->free_list = h->nodes[n].next;
+    h->num_nodes++;
+
+    return n;
+
+} /* end hl_new_node */
+
+/* puts every node in use (apart from the leaves) back into the buckets */
+static void hl_rehash(HashLife *h)
+{
+
+    int i, b;
+    HashNode *p;
+
+    for (i = 0; i < h->capacity; i++) {
+        h->buckets[i] = NO_NODE;
+    }
+    for (i = HL_NUM_LEAVES; i < h->capacity; i++) {
+        p = &h->nodes[i];
+        if (p->level != HL_FREE) {
+            b = hl_hash(p->quad[NW], p->quad[NE], p->quad[SW], p->quad[SE]) & (h->capacity - 1);
+            p->next = h->buckets[b];
+            h->buckets[b] = i;
+        }
+    }
+
+} /* end hl_rehash */
+
+static unsigned int hl_hash(int nw, int ne, int sw, int se)
+{
+
+    unsigned int x;
+
+    x = (unsigned int)nw * 0x9E3779B1u;
+    x = (x ^ (unsigned int)ne) * 0x85EBCA77u;
+    x = (x ^ (unsigned int)sw) * 0xC2B2AE3Du;
+    x = (x ^ (unsigned int)se) * 0x27D4EB2Fu;
+
+    return x ^ (x >> 15);
+
+} /* end hl_hash */
+
+/* returns the one node with these four children, making it if it 
+does not already exist */
+static int hl_join(HashLife *h, int nw, int ne, int sw, int se)
+{
+
+    int n, b;
+    HashNode *p;
+
+    b = hl_hash(nw, ne, sw, se) & (h->capacity - 1);
+    for (n = h->buckets[b]; n != NO_NODE; n = h->nodes[n].next) {
+        p = &h->nodes[n];
+        if (p->quad[NW] == nw && p->quad[NE] == ne && p->quad[SW] == sw && p->quad[SE] == se) {
+            return n;
+        }
+    }
+
+    /* the table may have grown, so the bucket is found again */
+    n = hl_new_node(h);
+    b = hl_hash(nw, ne, sw, se) & (h->capacity - 1);
+    p = &h->nodes[n];
+    p->quad[NW] = nw;
+    p->quad[NE] = ne;
+    p->quad[SW] = sw;
+    p->quad[SE] = se;
+    p->level = h->nodes[nw].level + 1;
+    p->result = NO_NODE;
+    p->marked = 0;
+    p->next = h->buckets[b];
+    h->buckets[b] = n;
+
+    return n;
+
+} /* end hl_join */
+
+static int hl_empty(HashLife *h, int level)
+{
+
+    int e;
+
+    if (level == 0) {
+        return HL_CELL_EMPTY;
+    }
+    if (h->empty[level] == NO_NODE) {
+        e = hl_empty(h, level - 1);
+        h->empty[level] = hl_join(h, e, e, e, e);
+    }
+
+    return h->empty[level];
+
+} /* end hl_empty */
+
+/* builds the node of the given level whose top left cell is board 
+cell (top, left). Cells outside the board are empty */
+static int hl_build(HashLife *h, state *board, int level, long long top, long long left)
+{
+
+    int nw, ne, sw, se;
+    long long half;
+
+    if (top >= h->rows || left >= h->cols) {
+        return hl_empty(h, level);
+    }
+    if (level == 0) {
+        return cell_code(board[top * h->cols + left]);
+    }
+
+    half = 1LL << (level - 1);
+    nw = hl_build(h, board, level - 1, top, left);
+    ne = hl_build(h, board, level - 1, top, left + half);
+    sw = hl_build(h, board, level - 1, top + half, left);
+    se = hl_build(h, board, level - 1, top + half, left + half);
+
+    return hl_join(h, nw, ne, sw, se);
+
+} /* end hl_build */
+
+/* the middle half of a node, at the same generation */
+static int hl_centre(HashLife *h, int n)
+{
+
+    int nw, ne, sw, se;
+
+    nw = h->nodes[h->nodes[n].quad[NW]].quad[SE];
+    ne = h->nodes[h->nodes[n].quad[NE]].quad[SW];
+    sw = h->nodes[h->nodes[n].quad[SW]].quad[NE];
+    se = h->nodes[h->nodes[n].quad[SE]].quad[NW];
+
+    return hl_join(h, nw, ne, sw, se);
+
+} /* end hl_centre */
+
+/* A level 2 node is 4 by 4 cells. The wireworld rules are applied 
+directly to its middle 2 by 2 cells, one generation on */
+static int hl_base_case(HashLife *h, int n)
+{
+
+    int grid[4][4], next[2][2];
+    int row, col, i, j, num_heads, child;
+
+    for (row = 0; row < 4; row++) {
+        for (col = 0; col < 4; col++) {
+            child = h->nodes[n].quad[(row / 2) * 2 + col / 2];
+            grid[row][col] = h->nodes[child].quad[(row % 2) * 2 + col % 2];
+        }
+    }
+
+    for (row = 1; row < 3; row++) {
+        for (col = 1; col < 3; col++) {
+            if (grid[row][col] == HL_CELL_HEAD) {
+                next[row - 1][col - 1] = HL_CELL_TAIL;
+            }
+            else if (grid[row][col] == HL_CELL_TAIL) {
+                next[row - 1][col - 1] = HL_CELL_CONDUCTOR;
+            }
+            else if (grid[row][col] == HL_CELL_CONDUCTOR) {
+                num_heads = 0;
+                for (i = -1; i < CELL_ROW_LIMIT; i++) {
+                    for (j = -1; j < CELL_COL_LIMIT; j++) {
+                        num_heads += ((i != 0 || j != 0) && grid[row + i][col + j] == HL_CELL_HEAD);
+                    }
+                }
+                next[row - 1][col - 1] = (num_heads >= HEADS_TO_FIRE_MIN && 
+                    num_heads <= HEADS_TO_FIRE_MAX) ? HL_CELL_HEAD : HL_CELL_CONDUCTOR;
+            }
+            else {
+                next[row - 1][col - 1] = HL_CELL_EMPTY;
+            }
+        }
+    }
+
+    return hl_join(h, next[0][0], next[0][1], next[1][0], next[1][1]);
+
+} /* end hl_base_case */
+
+/* Returns the centre of node n, 2^step generations later. The node 
+is split into 9 overlapping quarters, each is moved on (or just 
+centred if step is less than the most a node can do in one go), then 
+they are joined into 4 which are moved on again. Garbage is collected 
+here if the node pool is over its limit, so one huge step can't grow 
+it without bound - every node still needed is in a frame or the root */
+static int hl_successor(HashLife *h, int n, int step)
+{
+
+    HashFrame *f;
+    int level, row, col, child, inner_step, result;
+
+    level = h->nodes[n].level;
+    if (h->nodes[n].result != NO_NODE && h->nodes[n].step == step) {
+        return h->nodes[n].result;
+    }
+
+    if (n == h->empty[level]) {
+        result = hl_empty(h, level - 1);
+    }
+    else if (level == HL_MIN_LEVEL) {
+        result = hl_base_case(h, n);
+    }
+    else {
+        f = &h->frames[h->depth++];
+        memset(f, NO_NODE, sizeof(HashFrame));
+        if (h->num_nodes > h->max_nodes) {
+            hl_collect_garbage(h);
+        }
+
+        /* grandchildren as a 4 by 4 grid of nodes */
+        for (row = 0; row < 4; row++) {
+            for (col = 0; col < 4; col++) {
+                child = h->nodes[n].quad[(row / 2) * 2 + col / 2];
+                f->grid[row][col] = h->nodes[child].quad[(row % 2) * 2 + col % 2];
             }
-            /* skip the middle cell (the one being compared against) */
-            else if (i == 0 && j == 0) {
-                j++;                 
+        }
+
+        /* a full step of 2^(level - 2) is two half steps */
+        inner_step = (step == level - 2) ? level - 3 : step;
+        for (row = 0; row < 3; row++) {
+            for (col = 0; col < 3; col++) {
+                f->middle[row][col] = hl_join(h, f->grid[row][col], f->grid[row][col + 1], 
+                    f->grid[row + 1][col], f->grid[row + 1][col + 1]);
+                if (step == level - 2) {
+                    f->middle[row][col] = hl_successor(h, f->middle[row][col], inner_step);
+                }
+                else {
+                    f->middle[row][col] = hl_centre(h, f->middle[row][col]);
+                }
             }
-            else {
-                /* if cell contains 'H' add to total number of heads */
-                if (a[row + i][col + j] == ELECTRON_HEAD) {
-                    INCREMENT_NUM_HEADS; 
+        }
+
+        for (row = 0; row < 2; row++) {
+            for (col = 0; col < 2; col++) {
+                f->quarter[row][col] = hl_join(h, f->middle[row][col], f->middle[row][col + 1], 
+                    f->middle[row + 1][col], f->middle[row + 1][col + 1]);
+                f->quarter[row][col] = hl_successor(h, f->quarter[row][col], inner_step);
+            }
+        }
+
+        result = hl_join(h, f->quarter[0][0], f->quarter[0][1], f->quarter[1][0], f->quarter[1][1]);
+        h->depth--;
+    }
+
+    h->nodes[n].result = result;
+    h->nodes[n].step = step;
+
+    return result;
+
+} /* end hl_successor */
+
+/* doubles the size of the root, keeping it in the middle */
+static void hl_expand(HashLife *h)
+{
+
+    int e, level, nw, ne, sw, se;
+
+    level = h->nodes[h->root].level;
+    e = hl_empty(h, level - 1);
+    nw = hl_join(h, e, e, e, h->nodes[h->root].quad[NW]);
+    ne = hl_join(h, e, e, h->nodes[h->root].quad[NE], e);
+    sw = hl_join(h, e, h->nodes[h->root].quad[SW], e, e);
+    se = hl_join(h, h->nodes[h->root].quad[SE], e, e, e);
+    h->root = hl_join(h, nw, ne, sw, se);
+    h->origin_row += 1LL << (level - 1);
+    h->origin_col += 1LL << (level - 1);
+
+} /* end hl_expand */
+
+/* Wireworld circuits never grow, as empty cells stay empty, so a 
+root's result is exact as long as the board is inside its centre */
+static int hl_board_in_centre(HashLife *h)
+{
+
+    long long quarter;
+
+    quarter = 1LL << (h->nodes[h->root].level - 2);
+
+    return (h->origin_row >= quarter && h->origin_col >= quarter && 
+        h->origin_row + h->rows <= 3 * quarter && h->origin_col + h->cols <= 3 * quarter);
+
+} /* end hl_board_in_centre */
+
+/* moves the root on 2^step generations */
+static void hl_step(HashLife *h, int step)
+{
+
+    int level;
+
+    if (h->num_nodes > h->max_nodes) {
+        hl_collect_garbage(h);
+    }
+
+    while (h->nodes[h->root].level < step + 2 || !hl_board_in_centre(h)) {
+        hl_expand(h);
+    }
+
+    level = h->nodes[h->root].level;
+    h->root = hl_successor(h, h->root, step);
+    h->origin_row -= 1LL << (level - 2);
+    h->origin_col -= 1LL << (level - 2);
+
+    /* a limit raised during the step only lasts for that step */
+    h->max_nodes = HL_MAX_NODES;
+
+} /* end hl_step */
+
+/* moves the root on n generations, one power of 2 for each bit of n */
+static void hl_advance(HashLife *h, generation n)
+{
+
+    int bit;
+    generation i;
+
+    for (bit = 0; bit < HL_MAX_STEP; bit++) {
+        if (n & (1ULL << bit)) {
+            hl_step(h, bit);
+        }
+    }
+    /* the largest step is 2^60, so any higher bits are made up of those */
+    for (i = 0; i < (n >> HL_MAX_STEP); i++) {
+        hl_step(h, HL_MAX_STEP);
+    }
+
+} /* end hl_advance */
+
+static void hl_mark(HashLife *h, int n)
+{
+
+    int i;
+
+    if (h->nodes[n].marked) {
+        return;
+    }
+    h->nodes[n].marked = 1;
+    if (h->nodes[n].level > 0) {
+        for (i = 0; i < 4; i++) {
+            hl_mark(h, h->nodes[n].quad[i]);
+        }
+    }
+    if (h->nodes[n].result != NO_NODE) {
+        hl_mark(h, h->nodes[n].result);
+    }
+
+} /* end hl_mark */
+
+/* Frees the nodes no longer needed. Memoised results of the nodes 
+that are kept are kept too, unless they fill most of the pool - then 
+they are all forgotten, to be worked out again if they are needed */
+static void hl_collect_garbage(HashLife *h)
+{
+
+    int i;
+
+    hl_free_unreachable(h);
+    if (h->num_nodes > h->max_nodes / 2) {
+        for (i = 0; i < h->capacity; i++) {
+            h->nodes[i].result = NO_NODE;
+        }
+        hl_free_unreachable(h);
+    }
+
+    /* if most nodes are still in use, collecting again soon would 
+    free very little, so the limit is raised to twice what is left - 
+    up to HL_NODE_CEILING, past which the circuit is given up on. 
+    hl_step puts it back once the step is done */
+    if (h->num_nodes > h->max_nodes / 2) {
+        if (h->num_nodes > HL_NODE_CEILING / 2) {
+            fprintf(stderr, "Error: HashLife needs more than %d nodes, try -e graph\n", HL_NODE_CEILING);
+            exit(EXIT_FAILURE);
+        }
+        h->max_nodes = 2 * h->num_nodes;
+    }
+
+} /* end hl_collect_garbage */
+
+/* Frees every node that cannot be reached from the root, the empty 
+nodes, a frame of a step still being worked out or the result of a 
+node that can */
+static void hl_free_unreachable(HashLife *h)
+{
+
+    int i, k, *frame;
+
+    for (i = 0; i < h->capacity; i++) {
+        h->nodes[i].marked = (i < HL_NUM_LEAVES);
+    }
+    hl_mark(h, h->root);
+    for (i = 0; i <= HL_MAX_LEVEL; i++) {
+        if (h->empty[i] != NO_NODE) {
+            hl_mark(h, h->empty[i]);
+        }
+    }
+    for (i = 0; i < h->depth; i++) {
+        frame = (int *)&h->frames[i];
+        for (k = 0; k < (int)(sizeof(HashFrame) / sizeof(int)); k++) {
+            if (frame[k] != NO_NODE) {
+                hl_mark(h, frame[k]);
+            }
+        }
+    }
+
+    for (i = HL_NUM_LEAVES; i < h->capacity; i++) {
+        if (h->nodes[i].level != HL_FREE && !h->nodes[i].marked) {
+            h->nodes[i].level = HL_FREE;
+            h->nodes[i].next = h->free_list;
+            h->free_list = i;
+            h->num_nodes--;
+        }
+    }
+    hl_rehash(h);
+
+} /* end hl_free_unreachable */
+
+/* Writes the non-empty cells of node n into the board. (top, left) 
+is the board position of the node's top left cell */
+static void hl_to_array(HashLife *h, int n, long long top, long long left, state *board)
+{
+
+    static const state cells[HL_NUM_LEAVES] = {EMPTY, ELECTRON_HEAD, ELECTRON_TAIL, CONDUCTOR};
+    int level;
+    long long half;
+
+    level = h->nodes[n].level;
+    if (n == h->empty[level] || top >= h->rows || left >= h->cols || 
+        top + (1LL << level) <= 0 || left + (1LL << level) <= 0) {
+        return;
+    }
+    if (level == 0) {
+        board[top * h->cols + left] = cells[n];
+        return;
+    }
+
+    half = 1LL << (level - 1);
+    hl_to_array(h, h->nodes[n].quad[NW], top, left, board);
+    hl_to_array(h, h->nodes[n].quad[NE], top, left + half, board);
+    hl_to_array(h, h->nodes[n].quad[SW], top + half, left, board);
+    hl_to_array(h, h->nodes[n].quad[SE], top + half, left + half, board);
+
+} /* end hl_to_array */
+
+/* creates a delta stream file and writes its header. The first frame 
+is numbered by the board's generation */
+static void open_delta_stream(DeltaStream *ds, char *filename, Board *b, generation keyframe_interval)
+{
+
+    if ((ds->fp = fopen(filename, "wb")) == NULL) {
+        fprintf(stderr, "Error: Cannot open file\n");
+        exit(EXIT_FAILURE);
+    }
+    setvbuf(ds->fp, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+    ds->rows = b->rows;
+    ds->cols = b->cols;
+    ds->keyframe_interval = keyframe_interval;
+    ds->first = ds->frame = b->gen;
+    ds->previous = (state *)allocate_memory((size_t)b->rows * b->cols);
+
+    fwrite(DELTA_MAGIC, 1, DELTA_MAGIC_LENGTH, ds->fp);
+    write_varint(ds->fp, b->rows);
+    write_varint(ds->fp, b->cols);
+    write_varint(ds->fp, keyframe_interval);
+    write_varint(ds->fp, ds->first);
+
+} /* end open_delta_stream */
+
+/* Writes the next frame - the whole board if it is a keyframe, or 
+just the runs of cells that changed since the last frame */
+static void write_delta_frame(DeltaStream *ds, state *board)
+{
+
+    size_t size, cell, run_start, run_end, last_end, gap;
+    generation num_runs;
+
+    size = (size_t)ds->rows * ds->cols;
+
+    if (ds->frame % ds->keyframe_interval == 0 || ds->frame == ds->first) {
+        putc(DELTA_KEYFRAME, ds->fp);
+        fwrite(board, 1, size, ds->fp);
+    }
+    else {
+        /* count the runs first, as the count comes before them. Runs 
+        separated by MAX_RUN_GAP or fewer unchanged cells are joined, 
+        as the unchanged cells take less room than a new run */
+        num_runs = 0;
+        last_end = 0;
+        for (cell = 0; cell < size; cell++) {
+            if (board[cell] != ds->previous[cell]) {
+                if (num_runs == 0 || cell - last_end > MAX_RUN_GAP) {
+                    num_runs++;
                 }
-            j++; 
-            } 
-        } 
-        i++; 
-    } 
+                last_end = cell + 1;
+            }
+        }
 
-} /* end check_neighbouring_cells */
+        putc(DELTA_CHANGES, ds->fp);
+        write_varint(ds->fp, num_runs);
+        last_end = 0;
+        cell = 0;
+        while (num_runs-- > 0) {
+            while (board[cell] == ds->previous[cell]) {
+                cell++;
+            }
+            run_start = run_end = cell;
+            while (cell < size && cell - run_end <= MAX_RUN_GAP) {
+                if (board[cell] != ds->previous[cell]) {
+                    run_end = cell + 1;
+                }
+                cell++;
+            }
+            gap = run_start - last_end;
+            write_varint(ds->fp, gap);
+            write_varint(ds->fp, run_end - run_start);
+            fwrite(board + run_start, 1, run_end - run_start, ds->fp);
+            last_end = cell = run_end;
+        }
+    }
 
-/* This function determines whether a cell has been accessed which
-is out of bounds of the array, i.e. < 0 or > 40 */
-int check_cell_oob(int row, int col)
+    memcpy(ds->previous, board, size);
+    ds->frame++;
+
+} /* end write_delta_frame */
+
+static void close_delta_stream(DeltaStream *ds)
 {
 
-    if ((col < 0) ||  (row < 0) || (col >= MAX_COLS) || (row >= MAX_ROWS)) {
-        return OUT_OF_BOUNDS;  
+    if (fclose(ds->fp) != 0) {
+        fprintf(stderr, "Error: Cannot write delta stream\n");
+        exit(EXIT_FAILURE);
+    }
+    free(ds->previous);
+
+} /* end close_delta_stream */
+
+/* writes n 7 bits at a time, lowest bits first, with the top bit of 
+each byte set if there are more to come */
+static void write_varint(FILE *fp, generation n)
+{
+
+    while (n > VARINT_BITS) {
+        putc((int)((n & VARINT_BITS) | VARINT_MORE), fp);
+        n >>= VARINT_SHIFT;
+    }
+    putc((int)n, fp);
+
+} /* end write_varint */
+
+static int read_varint(FILE *fp, generation *n)
+{
+
+    int c, shift;
+
+    *n = 0;
+    shift = 0;
+    do {
+        if ((c = getc(fp)) == EOF || shift > 63) {
+            return INVALID;
+        }
+        *n |= (generation)(c & VARINT_BITS) << shift;
+        shift += VARINT_SHIFT;
+    } while (c & VARINT_MORE);
+
+    return VALID;
+
+} /* end read_varint */
+
+/* Prints frame n of a delta stream. Every frame up to n is applied in 
+turn, reading forward only, so the stream can come down a pipe */
+static void extract_frame(char *filename, generation n)
+{
+
+    FILE *fp;
+    char magic[DELTA_MAGIC_LENGTH];
+    generation rows, cols, keyframe_interval, first, frame, num_runs, gap, length;
+    size_t size, cell;
+    state *board;
+    int tag;
+
+    if ((fp = fopen(filename, "rb")) == NULL) {
+        fprintf(stderr, "Error: Cannot open file\n");
+        exit(EXIT_FAILURE);
+    }
+    if (fread(magic, 1, DELTA_MAGIC_LENGTH, fp) != DELTA_MAGIC_LENGTH || 
+        memcmp(magic, DELTA_MAGIC, DELTA_MAGIC_LENGTH) != 0 || 
+        read_varint(fp, &rows) == INVALID || read_varint(fp, &cols) == INVALID || 
+        read_varint(fp, &keyframe_interval) == INVALID || keyframe_interval == 0 || 
+        read_varint(fp, &first) == INVALID) {
+        fprintf(stderr, "Error: Not a wireworld delta stream\n");
+        exit(EXIT_FAILURE);
+    }
+    /* the sizes come from the file, so are checked before allocating */
+    if (rows == 0 || cols == 0 || rows > INT_MAX || cols > INT_MAX || rows > SIZE_MAX / cols) {
+        fprintf(stderr, "Error: Delta stream is corrupt\n");
+        exit(EXIT_FAILURE);
+    }
+    if (n < first) {
+        fprintf(stderr, "Error: Stream has no frame %llu\n", n);
+        exit(EXIT_FAILURE);
+    }
+
+    size = (size_t)rows * cols;
+    board = (state *)allocate_memory(size);
+    memset(board, EMPTY, size);
+
+    for (frame = first; frame <= n; frame++) {
+        if ((tag = getc(fp)) == EOF) {
+            fprintf(stderr, "Error: Stream has no frame %llu\n", n);
+            exit(EXIT_FAILURE);
+        }
+        if (tag == DELTA_KEYFRAME) {
+            if (fread(board, 1, size, fp) != size) {
+                fprintf(stderr, "Error: Delta stream is cut short\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (tag == DELTA_CHANGES) {
+            if (read_varint(fp, &num_runs) == INVALID) {
+                fprintf(stderr, "Error: Delta stream is cut short\n");
+                exit(EXIT_FAILURE);
+            }
+            cell = 0;
+            while (num_runs-- > 0) {
+                if (read_varint(fp, &gap) == INVALID || read_varint(fp, &length) == INVALID || 
+                    gap > size - cell || length > size - cell - gap) {
+                    fprintf(stderr, "Error: Delta stream is corrupt\n");
+                    exit(EXIT_FAILURE);
+                }
+                cell += gap;
+                if (fread(board + cell, 1, length, fp) != length) {
+                    fprintf(stderr, "Error: Delta stream is cut short\n");
+                    exit(EXIT_FAILURE);
+                }
+                cell += length;
+            }
+        }
+        else {
+            fprintf(stderr, "Error: Delta stream is corrupt\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    write_board(stdout, board, (int)rows, (int)cols);
+
+    free(board);
+    fclose(fp);
+
+} /* end extract_frame */
+#endif
+
+/* The library functions declared in wireworld.h. A handle keeps the 
+board as it was loaded, for its empty cells, and steps the conductor 
+graph - the board's conductors are only brought up to date when 
+the whole board is asked for */
+int ww_load(const char *filename, Wireworld **ww)
+{
+
+    int error;
+
+    if ((*ww = (Wireworld *)malloc(sizeof(Wireworld))) == NULL) {
+        return WW_ERROR_MEMORY;
+    }
+    if ((error = load_board(filename, &(*ww)->board)) != WW_OK) {
+        free(*ww);
+        return error;
+    }
+    if ((error = compile_graph(&(*ww)->graph, (*ww)->board.cells, 
+        (*ww)->board.rows, (*ww)->board.cols, &rules[RULE_WIREWORLD])) != WW_OK) {
+        free((*ww)->board.cells);
+        free(*ww);
+        return error;
+    }
+
+    return WW_OK;
+
+} /* end ww_load */
+
+int ww_create(int rows, int cols, const char *cells, Wireworld **ww)
+{
+
+    size_t i, num_cells;
+    int error;
+
+    if (rows <= 0 || cols <= 0) {
+        return WW_ERROR_RANGE;
+    }
+    num_cells = (size_t)rows * cols;
+    for (i = 0; i < num_cells; i++) {
+        if (cells[i] != EMPTY && !is_conductor(cells[i])) {
+            return WW_ERROR_CHARACTER;
+        }
+    }
+
+    if ((*ww = (Wireworld *)malloc(sizeof(Wireworld))) == NULL) {
+        return WW_ERROR_MEMORY;
+    }
+    if (((*ww)->board.cells = (state *)malloc(num_cells)) == NULL) {
+        free(*ww);
+        return WW_ERROR_MEMORY;
+    }
+    memcpy((*ww)->board.cells, cells, num_cells);
+    (*ww)->board.rows = rows;
+    (*ww)->board.cols = cols;
+    (*ww)->board.gen = 0;
+    if ((error = compile_graph(&(*ww)->graph, (*ww)->board.cells, rows, cols, 
+        &rules[RULE_WIREWORLD])) != WW_OK) {
+        free((*ww)->board.cells);
+        free(*ww);
+        return error;
+    }
+
+    return WW_OK;
+
+} /* end ww_create */
+
+int ww_step(Wireworld *ww, unsigned long long n)
+{
+
+    generation i;
+
+    for (i = 0; i < n; i++) {
+        step_graph(&ww->graph);
+    }
+    ww->board.gen += n;
+
+    return WW_OK;
+
+} /* end ww_step */
+
+int ww_get_cell(Wireworld *ww, int row, int col, char *c)
+{
+
+    int i;
+
+    if (row < 0 || col < 0 || row >= ww->board.rows || col >= ww->board.cols) {
+        return WW_ERROR_RANGE;
+    }
+    if ((i = find_conductor(&ww->graph, row * ww->board.cols + col)) == NOT_A_CONDUCTOR) {
+        *c = EMPTY;
     }
     else {
-        return IN_RANGE;  
+        *c = ww->graph.cells[i];
     }
 
-} /* end check_cell_oob */
+    return WW_OK;
+
+} /* end ww_get_cell */
 
-void copy_array(state new_arr[][MAX_COLS], state arr[][MAX_COLS])
+/* Changing a conductor's state only changes the graph, but making a 
+cell empty or a conductor changes which cells are neighbours, so 
+the graph is compiled again */
+int ww_set_cell(Wireworld *ww, int row, int col, char c)
 {
 
-    int row, col;
+    Graph g;
+    int i, error;
 
-    for (row = 0; row < MAX_ROWS; row++) {
-        for (col = 0; col < MAX_COLS; col++) {
-            arr[row][col] = new_arr[row][col]; 
-        } 
+    if (row < 0 || col < 0 || row >= ww->board.rows || col >= ww->board.cols) {
+        return WW_ERROR_RANGE;
+    }
+    if (c != EMPTY && !is_conductor(c)) {
+        return WW_ERROR_CHARACTER;
     }
 
-} /* end copy_array */
+    i = find_conductor(&ww->graph, row * ww->board.cols + col);
+    if (i != NOT_A_CONDUCTOR && c != EMPTY) {
+        ww->graph.cells[i] = c;
+        return WW_OK;
+    }
+    if (i == NOT_A_CONDUCTOR && c == EMPTY) {
+        return WW_OK;
+    }
+
+    graph_to_array(&ww->graph, ww->board.cells);
+    ww->board.cells[row * ww->board.cols + col] = c;
+    if ((error = compile_graph(&g, ww->board.cells, ww->board.rows, ww->board.cols, 
+        ww->graph.rule)) != WW_OK) {
+        /* the handle is left as it was */
+        ww->board.cells[row * ww->board.cols + col] = (c == EMPTY) ? ww->graph.cells[i] : EMPTY;
+        return error;
+    }
+    free_graph(&ww->graph);
+    ww->graph = g;
+
+    return WW_OK;
+
+} /* end ww_set_cell */
+
+int ww_get_board(Wireworld *ww, char *cells)
+{
+
+    graph_to_array(&ww->graph, ww->board.cells);
+    memcpy(cells, ww->board.cells, (size_t)ww->board.rows * ww->board.cols);
+
+    return WW_OK;
+
+} /* end ww_get_board */
+
+int ww_rows(Wireworld *ww)
+{
+
+    return ww->board.rows;
+
+} /* end ww_rows */
+
+int ww_cols(Wireworld *ww)
+{
+
+    return ww->board.cols;
+
+} /* end ww_cols */
+
+unsigned long long ww_generation(Wireworld *ww)
+{
+
+    return ww->board.gen;
+
+} /* end ww_generation */
+
+void ww_free(Wireworld *ww)
+{
+
+    if (ww != NULL) {
+        free_graph(&ww->graph);
+        free(ww->board.cells);
+        free(ww);
+    }
+
+} /* end ww_free */
+
+const char *ww_error_message(int error)
+{
+
+    switch (error) {
+    case WW_OK:
+        return "No error";
+    case WW_ERROR_OPEN:
+        return "Cannot open file";
+    case WW_ERROR_CHARACTER:
+        return "Invalid character in file";
+    case WW_ERROR_FORMAT:
+        return "File is damaged or not a wireworld file";
+    case WW_ERROR_MEMORY:
+        return "Cannot allocate space. Not enough memory";
+    case WW_ERROR_RANGE:
+        return "Cell is off the board";
+    default:
+        return "Unknown error";
+    }
+
+} /* end ww_error_message */
@@ -0,0 +1,43 @@
+/* Wireworld library */
+/* Lets another program load a wireworld circuit, run it for any
+number of generations and read or change its cells, without the
+ncurses front end. Build wireworld.c with -DWW_LIBRARY to leave out
+main and the animation, and link the object with your own program.
+Everything else in it is static, so only the ww_ names are exported.
+Like wireworld.c, this header needs C99 for unsigned long long.
+
+A circuit is only reached through a Wireworld handle. Every function
+that can fail returns WW_OK or one of the errors below rather than
+exiting, and ww_error_message turns an error into a message. Cells
+are the same characters as in a wireworld file - ' ' empty, 'H' an
+electron head, 't' an electron tail and 'c' a conductor */
+
+#ifndef WIREWORLD_H
+#define WIREWORLD_H
+
+#define WW_OK 0
+#define WW_ERROR_OPEN 1 /* the file could not be opened or read */
+#define WW_ERROR_CHARACTER 2 /* the file has a character that isn't a cell */
+#define WW_ERROR_FORMAT 3 /* an RLE or packed file is damaged */
+#define WW_ERROR_MEMORY 4 /* not enough memory */
+#define WW_ERROR_RANGE 5 /* a row or col is off the board, or a size is not positive */
+
+typedef struct wireworld Wireworld;
+
+/* reads a text, RLE or packed file into a new handle */
+int ww_load(const char *filename, Wireworld **ww);
+/* makes a new handle from rows * cols cells, a row at a time */
+int ww_create(int rows, int cols, const char *cells, Wireworld **ww);
+/* runs n generations */
+int ww_step(Wireworld *ww, unsigned long long n);
+int ww_get_cell(Wireworld *ww, int row, int col, char *c);
+int ww_set_cell(Wireworld *ww, int row, int col, char c);
+/* copies every cell into cells, which must hold rows * cols */
+int ww_get_board(Wireworld *ww, char *cells);
+int ww_rows(Wireworld *ww);
+int ww_cols(Wireworld *ww);
+unsigned long long ww_generation(Wireworld *ww);
+void ww_free(Wireworld *ww);
+const char *ww_error_message(int error);
+
+#endif